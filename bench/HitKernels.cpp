@@ -0,0 +1,113 @@
+/**
+ * Measures Sphere::hit() and Triangle::hit() on their own, every ray of a
+ * random set against every primitive of another, so that what is timed
+ * is the vector math of the kernels rather than any traversal. Reported
+ * in millions of ray-primitive tests per second. Built with
+ * -DRAYTRACER_NO_SIMD it measures the scalar Vec3 instead, for comparison.
+ *
+ * Usage -- HitKernels.out [primitives] [rays]
+ **/
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+
+#include "../graphics/Sphere.h"
+#include "../graphics/Triangle.h"
+
+struct PassResult
+{
+    double   seconds;
+    uint32_t num_hits;
+};
+
+/**
+ * Every ray against every primitive, keeping the nearest hit of each ray.
+ * The fastest of repeats passes is kept, the others being slowed by
+ * whatever else the machine was doing
+ **/
+template <typename T>
+static PassResult trace(const std::vector<T>& primitives, const std::vector<Ray>& rays, const uint32_t repeats)
+{
+    using std::chrono::high_resolution_clock;
+    using std::chrono::duration;
+
+    PassResult result = {};
+    for(uint32_t n = 0; n < repeats; n++)
+    {
+        uint32_t num_hits = 0;
+        auto begin = high_resolution_clock::now();
+        for(const Ray& r : rays)
+        {
+            HitRecord rec   = {};
+            scalar    t_max = FLT_MAX;
+            for(const T& primitive : primitives)
+            {
+                if(primitive.hit(r, 1e-3, t_max, rec))
+                {
+                    t_max = rec.t;
+                    num_hits++;
+                }
+            }
+        }
+        const double seconds = duration<double>(high_resolution_clock::now() - begin).count();
+        if(n == 0 || seconds < result.seconds)
+            result = PassResult { seconds, num_hits };
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t num_primitives = argc > 1 ? std::atoi(argv[1]) : 256;
+    const uint32_t num_rays       = argc > 2 ? std::atoi(argv[2]) : 4096;
+    const uint32_t REPEATS        = 10;
+
+    // Primitives within a 20 unit cube, rays from its sides towards random points inside
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<scalar> coord(-10.0f, 10.0f);
+    std::uniform_real_distribution<scalar> size (0.1f, 1.0f);
+    auto random_point = [&]() { return Vec3({ coord(rng), coord(rng), coord(rng) }); };
+
+    Lambertian material(Vec3({ 0.5, 0.5, 0.5 }));
+
+    std::vector<Sphere>   spheres;
+    std::vector<Triangle> triangles;
+    spheres  .reserve(num_primitives);
+    triangles.reserve(num_primitives);
+    for(uint32_t i = 0; i < num_primitives; i++)
+    {
+        spheres.push_back(Sphere(random_point(), size(rng), &material));
+
+        const Vec3 v0 = random_point();
+        triangles.push_back(Triangle(v0, v0 + size(rng) * random_point() * 0.2f,
+                                         v0 + size(rng) * random_point() * 0.2f, &material));
+    }
+
+    std::vector<Ray> rays;
+    rays.reserve(num_rays);
+    for(uint32_t i = 0; i < num_rays; i++)
+    {
+        Vec3 origin = random_point();
+        origin[i % 3] = i % 2 ? 15.0f : -15.0f;
+        rays.push_back(Ray(origin, random_point() - origin));
+    }
+
+    // Warm up both before measuring
+    trace(spheres,   rays, 1);
+    trace(triangles, rays, 1);
+
+    const PassResult sphere_pass   = trace(spheres,   rays, REPEATS);
+    const PassResult triangle_pass = trace(triangles, rays, REPEATS);
+
+    const double tests = double(num_rays) * num_primitives;
+    std::printf("---------------------------------\n");
+    std::printf("[BENCH] %u primitives x %u rays, best of %u, sizeof(Vec3) = %zu\n",
+                num_primitives, num_rays, REPEATS, sizeof(Vec3));
+    std::printf("[BENCH]     Sphere::hit   %8.2f Mtests/s (%u hits)\n",
+                tests / sphere_pass.seconds * 1e-6, sphere_pass.num_hits);
+    std::printf("[BENCH]     Triangle::hit %8.2f Mtests/s (%u hits)\n",
+                tests / triangle_pass.seconds * 1e-6, triangle_pass.num_hits);
+    return 0;
+}
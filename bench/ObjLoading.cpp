@@ -0,0 +1,168 @@
+/**
+ * Measures how long it takes to load a large .OBJ model, comparing the
+ * line by line std::istringstream parsing the loader used to do against
+ * the memory mapped parser, and reports the BVH build separately. Both
+ * of the latter use every hardware thread.
+ *
+ * Without a file, a grid of quads with texture coordinates and normals
+ * (2 x grid size^2 triangles, 1000 by default) is written to 
+ * ObjLoading_grid.obj first.
+ *
+ * Usage -- ObjLoading.out [obj file | --grid size]
+ **/
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "../graphics/ObjLoader.h"
+#include "../util/ParallelFor.h"
+
+using BenchClock = std::chrono::high_resolution_clock;
+
+static double seconds_since(const BenchClock::time_point begin)
+{
+    return std::chrono::duration<double>(BenchClock::now() - begin).count();
+}
+
+static void write_grid(const std::string& path, const uint32_t size)
+{
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if(file == nullptr)
+        throw std::runtime_error("[Error] Could not write " + path);
+
+    const uint32_t n = size + 1;
+    for(uint32_t y = 0; y < n; y++)
+    {
+        for(uint32_t x = 0; x < n; x++)
+        {
+            const float u = float(x) / size, v = float(y) / size;
+            std::fprintf(file, "v %f %f %f\nvt %f %f\nvn %f %f %f\n", u, 0.05f * std::sin(20.0f * u), v, u, v, 0.0f, 1.0f, 0.0f);
+        }
+    }
+    for(uint32_t y = 0; y < size; y++)
+    {
+        for(uint32_t x = 0; x < size; x++)
+        {
+            const uint32_t a = y * n + x + 1, b = a + 1, c = a + n + 1, d = a + n;
+            std::fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c, d, d, d);
+        }
+    }
+    std::fclose(file);
+}
+
+/**
+ * What Scene::load_3d_obj_from_file used to do: count the vertices in a
+ * first pass, then parse every line through an std::istringstream.
+ * Only triangles in the v//vn or v/vt/vn forms, as it supported
+ **/
+static void load_obj_istringstream(const std::string& path, TriangleMesh& mesh)
+{
+    std::ifstream input_file(path);
+    std::string line;
+
+    std::size_t num_vertices = 0, num_normals = 0;
+    while(std::getline(input_file, line))
+    {
+        if(line.find("v ") == 0)  num_vertices++;
+        if(line.find("vn ") == 0) num_normals++;
+    }
+    input_file.clear();
+    input_file.seekg(0);
+    mesh.reserve(num_vertices, num_normals, 2 * num_vertices);
+
+    while(std::getline(input_file, line))
+    {
+        std::istringstream istr(line);
+        std::string keyword;
+        istr >> keyword;
+        if(keyword == "v" || keyword == "vn")
+        {
+            float x, y, z;
+            istr >> x >> y >> z;
+            (keyword == "v" ? mesh.vertices : mesh.normals).push_back(Vec3({ x, y, z }));
+        }
+        else if(keyword == "f")
+        {
+            uint32_t v[4], n[4];
+            int corners = 0;
+            std::string corner;
+            while(corners < 4 && istr >> corner)
+            {
+                std::istringstream fields(corner);
+                char slash;
+                uint32_t t;
+                fields >> v[corners] >> slash;
+                if(fields.peek() != '/')
+                    fields >> t;
+                fields >> slash >> n[corners];
+                corners++;
+            }
+            for(int i = 1; i + 1 < corners; i++)
+                mesh.add_triangle(v[0] - 1, v[i] - 1, v[i + 1] - 1, n[0] - 1, n[i] - 1, n[i + 1] - 1);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string path      = "ObjLoading_grid.obj";
+    uint32_t    grid_size = 1000;
+    bool        make_grid = true;
+
+    if(argc > 2 && std::strcmp(argv[1], "--grid") == 0)
+        grid_size = std::atoi(argv[2]);
+    else if(argc > 1)
+    {
+        path      = argv[1];
+        make_grid = false;
+    }
+
+    if(make_grid)
+    {
+        std::printf("Writing a %u x %u grid to %s\n", grid_size, grid_size, path.c_str());
+        write_grid(path, grid_size);
+    }
+
+    std::ifstream size_probe(path, std::ios::binary | std::ios::ate);
+    const double megabytes = double(size_probe.tellg()) / (1024.0 * 1024.0);
+
+    try {
+        TriangleMesh reference(nullptr);
+        auto begin = BenchClock::now();
+        load_obj_istringstream(path, reference);
+        const double istringstream_seconds = seconds_since(begin);
+
+        TriangleMesh mesh(nullptr);
+        begin = BenchClock::now();
+        load_obj(path, mesh);
+        const double mapped_seconds = seconds_since(begin);
+
+        begin = BenchClock::now();
+        mesh.build();
+        const double build_seconds = seconds_since(begin);
+
+        std::printf("%.1f MB, %zu vertices, %zu triangles (%zu with istringstream), %u threads\n", megabytes,
+                    mesh.vertices.size(), mesh.num_triangles(), reference.num_triangles(), hardware_threads());
+        std::printf("%-16s %10s %10s %14s\n", "", "seconds", "MB/s", "Mtriangles/s");
+        std::printf("%-16s %10.3f %10.1f %14.2f\n", "istringstream", istringstream_seconds,
+                    megabytes / istringstream_seconds, 1e-6 * reference.num_triangles() / istringstream_seconds);
+        std::printf("%-16s %10.3f %10.1f %14.2f\n", "mapped", mapped_seconds,
+                    megabytes / mapped_seconds, 1e-6 * mesh.num_triangles() / mapped_seconds);
+        std::printf("%-16s %10.3f %10s %14.2f\n", "BVH build", build_seconds, "",
+                    1e-6 * mesh.num_triangles() / build_seconds);
+        std::printf("Speedup of the parser: %.1fx\n", istringstream_seconds / mapped_seconds);
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+        return -1;
+    }
+    return 0;
+}
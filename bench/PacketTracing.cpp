@@ -0,0 +1,172 @@
+/**
+ * Compares tracing camera rays one at a time against tracing them as ray
+ * packets of 8 x 8 and 16 x 16 pixels, first for the primary hits alone
+ * and then for whole paths, i.e. full renders of the scene. Both are
+ * reported in millions of camera rays per second.
+ *
+ * Usage -- PacketTracing.out [description file] [threads]
+ **/
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+
+#include "../graphics/Scene.h"
+#include "../graphics/Camera.h"
+#include "../util/Threading.h"
+
+struct PassResult
+{
+    double   seconds;
+    uint32_t num_hits;
+};
+
+/**
+ * Finds the primary hit of every pixel center, in blocks of block x block
+ * pixels traced as packets, or one ray at a time for a block of 0
+ **/
+static PassResult trace_primary(const Scene& scene, const Camera& camera, const uint32_t block, const uint32_t repeats)
+{
+    using std::chrono::high_resolution_clock;
+    using std::chrono::duration;
+
+    const scalar IW_DENOM = 1 / scalar(scene.image_width);
+    const scalar IH_DENOM = 1 / scalar(scene.image_height);
+    const uint32_t step   = block == 0 ? 1 : block;
+
+    RayPacket              packet;
+    std::vector<HitRecord> recs(step * step);
+
+    PassResult result = {};
+    auto begin = high_resolution_clock::now();
+    for(uint32_t n = 0; n < repeats; n++)
+    {
+        for(uint32_t block_y = 0; block_y < scene.image_height; block_y += step)
+        {
+            for(uint32_t block_x = 0; block_x < scene.image_width; block_x += step)
+            {
+                const uint32_t width  = std::min(step, scene.image_width  - block_x);
+                const uint32_t height = std::min(step, scene.image_height - block_y);
+
+                if(block == 0)
+                {
+                    HitRecord rec = {};
+                    const Ray r   = camera.get_ray((block_x + 0.5f) * IW_DENOM, (block_y + 0.5f) * IH_DENOM);
+                    if(scene.anything_hit(r, 1e-3, FLT_MAX, rec))
+                        result.num_hits++;
+                    continue;
+                }
+
+                packet.reset(camera.origin, width * height);
+                for(uint32_t y = 0; y < height; y++)
+                {
+                    for(uint32_t x = 0; x < width; x++)
+                    {
+                        const Ray r = camera.get_ray((block_x + x + 0.5f) * IW_DENOM, (block_y + y + 0.5f) * IH_DENOM);
+                        packet.set_direction(y * width + x, r.direction());
+                    }
+                }
+                packet.prepare();
+                scene.anything_hit_packet(packet, 1e-3, recs.data());
+
+                for(uint32_t i = 0; i < packet.count; i++)
+                {
+                    if(packet.t_max[i] < FLT_MAX)
+                        result.num_hits++;
+                }
+            }
+        }
+    }
+    result.seconds = duration<double>(high_resolution_clock::now() - begin).count();
+    return result;
+}
+
+static double render(Scene& scene, const Camera& camera, const uint32_t num_threads)
+{
+    using std::chrono::high_resolution_clock;
+    using std::chrono::duration;
+
+    RenderThreadControl thread_control;
+    thread_control.image.image_width  = scene.image_width;
+    thread_control.image.image_height = scene.image_height;
+    thread_control.image.num_samples  = scene.num_samples;
+    thread_control.image.world        = &scene;
+    thread_control.image.camera       = const_cast<Camera*>(&camera);
+    thread_control.image.pixels       = std::vector<Vec3>(scene.image_width * scene.image_height);
+    thread_control.thread_stats       = std::vector<int>(num_threads);
+    create_tile_sections(thread_control.image, scene.tile_size);
+
+    std::vector<ThreadHandle> render_threads(num_threads);
+
+    auto begin = high_resolution_clock::now();
+    initialize_mutex     (&thread_control);
+    create_render_threads(render_threads.data(), num_threads, &thread_control);
+    join_render_threads  (render_threads.data(), num_threads);
+    const double seconds = duration<double>(high_resolution_clock::now() - begin).count();
+
+    cleanup_threads(&thread_control, render_threads.data(), num_threads);
+    return seconds;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::printf("Usage -- PacketTracing.out [description file] [threads]\n");
+        return 1;
+    }
+
+    Scene scene;
+    try {
+        scene.read_from_file(argv[1]);
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+        return -1;
+    }
+
+    const uint32_t num_threads = argc > 2 ? std::atoi(argv[2])
+                                          : std::max(1u, std::thread::hardware_concurrency());
+
+    Camera camera(scene.camera_pos, scene.camera_look, Vec3({ 0, 1.0, 0 }),
+                  scene.camera_fov, scalar(scene.image_width) / scalar(scene.image_height));
+
+    const uint32_t REPEATS  = 8;
+    const uint32_t BLOCKS[] = { 0, 8, 16 };
+    const char*    NAMES[]  = { "Single", "8 x 8", "16 x 16" };
+
+    const double pixels = double(scene.image_width) * scene.image_height;
+
+    // Warm up, page in the scene
+    trace_primary(scene, camera, 0, 1);
+
+    std::printf("---------------------------------\n");
+    std::printf("[BENCH] %s, primary rays only (%.0f rays x %u)\n", argv[1], pixels, REPEATS);
+    double single = 0.0;
+    for(int i = 0; i < 3; i++)
+    {
+        const PassResult pass = trace_primary(scene, camera, BLOCKS[i], REPEATS);
+        if(i == 0)
+            single = pass.seconds;
+        std::printf("[BENCH]     %-8s %8.3f Mrays/s %7.2fx (%u hits)\n", NAMES[i],
+                    pixels * REPEATS / pass.seconds * 1e-6, single / pass.seconds, pass.num_hits);
+    }
+
+    scene.packet_size = 0;
+    render(scene, camera, num_threads);
+
+    std::printf("[BENCH] %s, full paths (%.0f rays x %u samples, %u threads)\n",
+                argv[1], pixels, scene.num_samples, num_threads);
+    for(int i = 0; i < 3; i++)
+    {
+        scene.packet_size = BLOCKS[i];
+        const double seconds = render(scene, camera, num_threads);
+        if(i == 0)
+            single = seconds;
+        std::printf("[BENCH]     %-8s %8.3f Mrays/s %7.2fx\n", NAMES[i],
+                    pixels * scene.num_samples / seconds * 1e-6, single / seconds);
+    }
+    return 0;
+}
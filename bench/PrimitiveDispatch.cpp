@@ -0,0 +1,110 @@
+/**
+ * Compares the closest-hit throughput of the built-in primitives when they 
+ * are each an individually allocated Primitive* behind a virtual call, 
+ * against the same primitives grouped by type in a PrimitiveGroup.
+ *
+ * Usage -- PrimitiveDispatch.out [description file] [description file] ...
+ **/
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <iostream>
+
+#include "../graphics/Scene.h"
+#include "../graphics/Camera.h"
+
+struct PassResult
+{
+    double   seconds;
+    uint32_t num_hits;
+};
+
+static std::vector<Ray> generate_rays(const Scene& scene)
+{
+    Camera camera(scene.camera_pos, scene.camera_look, Vec3({ 0, 1.0, 0 }),
+                  scene.camera_fov, scalar(scene.image_width) / scalar(scene.image_height));
+
+    // Primary rays, followed by a diffuse-like bounce off of whatever they hit
+    std::vector<Ray> rays;
+    rays.reserve(2 * scene.image_width * scene.image_height);
+    for(uint32_t y = 0; y < scene.image_height; y++)
+    {
+        for(uint32_t x = 0; x < scene.image_width; x++)
+        {
+            Ray r = camera.get_ray((x + 0.5f) / scene.image_width, (y + 0.5f) / scene.image_height);
+            rays.push_back(r);
+
+            HitRecord rec = {};
+            if(scene.anything_hit(r, 1e-3, FLT_MAX, rec))
+                rays.push_back(Ray(rec.point_at_t, rec.normal + random_in_unit_sphere()));
+        }
+    }
+    return rays;
+}
+
+static PassResult trace(const Scene& scene, const std::vector<Ray>& rays, const uint32_t repeats)
+{
+    using std::chrono::high_resolution_clock;
+    using std::chrono::duration;
+
+    PassResult result = {};
+    auto begin = high_resolution_clock::now();
+    for(uint32_t i = 0; i < repeats; i++)
+    {
+        for(const Ray& r : rays)
+        {
+            HitRecord rec = {};
+            if(scene.anything_hit(r, 1e-3, FLT_MAX, rec))
+                result.num_hits++;
+        }
+    }
+    result.seconds = duration<double>(high_resolution_clock::now() - begin).count();
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::printf("Usage -- PrimitiveDispatch.out [description file] ...\n");
+        return 1;
+    }
+
+    const uint32_t REPEATS = 4;
+
+    for(int i = 1; i < argc; i++)
+    {
+        Scene virtual_scene;
+        Scene grouped_scene;
+        virtual_scene.group_primitives = false;
+        grouped_scene.group_primitives = true;
+
+        try {
+            virtual_scene.read_from_file(argv[i]);
+            grouped_scene.read_from_file(argv[i]);
+        }
+        catch (std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return -1;
+        }
+
+        const std::vector<Ray> rays = generate_rays(grouped_scene);
+
+        // Warm up both before measuring
+        trace(virtual_scene, rays, 1);
+        trace(grouped_scene, rays, 1);
+
+        const PassResult virtual_pass = trace(virtual_scene, rays, REPEATS);
+        const PassResult grouped_pass = trace(grouped_scene, rays, REPEATS);
+
+        const double total_rays = double(rays.size()) * REPEATS;
+        std::printf("---------------------------------\n");
+        std::printf("[BENCH] %s (%zu rays x %u)\n", argv[i], rays.size(), REPEATS);
+        std::printf("[BENCH]     Virtual: %8.3f Mrays/s (%u hits)\n",
+                    total_rays / virtual_pass.seconds * 1e-6, virtual_pass.num_hits);
+        std::printf("[BENCH]     Grouped: %8.3f Mrays/s (%u hits)\n",
+                    total_rays / grouped_pass.seconds * 1e-6, grouped_pass.num_hits);
+        std::printf("[BENCH]     Speedup: %8.2fx\n", virtual_pass.seconds / grouped_pass.seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * Measures how the tile renderer scales with the number of threads, by
+ * rendering the same scene with 1, 2, 4, ... up to the number of hardware
+ * threads (or the given maximum) and reporting the speedup over one thread.
+ *
+ * Usage -- ThreadScaling.out [description file] [max threads]
+ **/
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+
+#include "../graphics/Scene.h"
+#include "../graphics/Camera.h"
+#include "../util/Threading.h"
+
+static double render(Scene& scene, const Camera& camera, const uint32_t num_threads)
+{
+    using std::chrono::high_resolution_clock;
+    using std::chrono::duration;
+
+    RenderThreadControl thread_control;
+    thread_control.image.image_width  = scene.image_width;
+    thread_control.image.image_height = scene.image_height;
+    thread_control.image.num_samples  = scene.num_samples;
+    thread_control.image.world        = &scene;
+    thread_control.image.camera       = const_cast<Camera*>(&camera);
+    thread_control.image.pixels       = std::vector<Vec3>(scene.image_width * scene.image_height);
+    thread_control.thread_stats       = std::vector<int>(num_threads);
+    create_tile_sections(thread_control.image, scene.tile_size);
+
+    std::vector<ThreadHandle> render_threads(num_threads);
+
+    auto begin = high_resolution_clock::now();
+    initialize_mutex     (&thread_control);
+    create_render_threads(render_threads.data(), num_threads, &thread_control);
+    join_render_threads  (render_threads.data(), num_threads);
+    const double seconds = duration<double>(high_resolution_clock::now() - begin).count();
+
+    cleanup_threads(&thread_control, render_threads.data(), num_threads);
+    return seconds;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::printf("Usage -- ThreadScaling.out [description file] [max threads]\n");
+        return 1;
+    }
+
+    Scene scene;
+    try {
+        scene.read_from_file(argv[1]);
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+        return -1;
+    }
+
+    const uint32_t max_threads = argc > 2 ? std::atoi(argv[2])
+                                          : std::max(1u, std::thread::hardware_concurrency());
+
+    Camera camera(scene.camera_pos, scene.camera_look, Vec3({ 0, 1.0, 0 }),
+                  scene.camera_fov, scalar(scene.image_width) / scalar(scene.image_height));
+
+    // Warm up the caches, page in the scene
+    render(scene, camera, max_threads);
+
+    const double paths = double(scene.image_width) * scene.image_height * scene.num_samples;
+
+    std::printf("%8s %10s %12s %9s %11s\n", "threads", "seconds", "Mpaths/s", "speedup", "efficiency");
+    double single = 0.0;
+    for(uint32_t n = 1; ; n = std::min(2 * n, max_threads))
+    {
+        const double seconds = render(scene, camera, n);
+        if(n == 1)
+            single = seconds;
+
+        std::printf("%8u %10.3f %12.3f %8.2fx %10.0f%%\n", n, seconds, 1e-6 * paths / seconds,
+                    single / seconds, 100.0 * single / (seconds * n));
+        if(n == max_threads)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * Compares rendering a scene path by path against rendering it in
+ * wavefront mode, where each tile's paths advance a bounce at a time and
+ * are shaded in batches of one material. Reported in millions of paths per
+ * second, best of a few renders each
+ *
+ * Usage -- WavefrontShading.out [description file] [threads]
+ **/
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+
+#include "../graphics/Scene.h"
+#include "../graphics/Camera.h"
+#include "../util/Threading.h"
+
+static double render(Scene& scene, const Camera& camera, const uint32_t num_threads)
+{
+    using std::chrono::high_resolution_clock;
+    using std::chrono::duration;
+
+    RenderThreadControl thread_control;
+    thread_control.image.image_width  = scene.image_width;
+    thread_control.image.image_height = scene.image_height;
+    thread_control.image.num_samples  = scene.num_samples;
+    thread_control.image.world        = &scene;
+    thread_control.image.camera       = const_cast<Camera*>(&camera);
+    thread_control.image.pixels       = std::vector<Vec3>(scene.image_width * scene.image_height);
+    thread_control.thread_stats       = std::vector<int>(num_threads);
+    create_tile_sections(thread_control.image, scene.tile_size);
+
+    std::vector<ThreadHandle> render_threads(num_threads);
+
+    auto begin = high_resolution_clock::now();
+    initialize_mutex     (&thread_control);
+    create_render_threads(render_threads.data(), num_threads, &thread_control);
+    join_render_threads  (render_threads.data(), num_threads);
+    const double seconds = duration<double>(high_resolution_clock::now() - begin).count();
+
+    cleanup_threads(&thread_control, render_threads.data(), num_threads);
+    return seconds;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::printf("Usage -- WavefrontShading.out [description file] [threads]\n");
+        return 1;
+    }
+
+    Scene scene;
+    try {
+        scene.read_from_file(argv[1]);
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+        return -1;
+    }
+
+    const uint32_t num_threads = argc > 2 ? std::atoi(argv[2])
+                                          : std::max(1u, std::thread::hardware_concurrency());
+
+    Camera camera(scene.camera_pos, scene.camera_look, Vec3({ 0, 1.0, 0 }),
+                  scene.camera_fov, scalar(scene.image_width) / scalar(scene.image_height));
+
+    const uint32_t RUNS    = 3;
+    const bool     MODES[] = { false, true };
+    const char*    NAMES[] = { "Per path", "Wavefront" };
+
+    const double paths = double(scene.image_width) * scene.image_height * scene.num_samples;
+
+    // Warm up, page in the scene
+    scene.wavefront = false;
+    render(scene, camera, num_threads);
+
+    std::printf("---------------------------------\n");
+    std::printf("[BENCH] %s (%.0f paths, %u threads, best of %u)\n", argv[1], paths, num_threads, RUNS);
+    double per_path = 0.0;
+    for(int i = 0; i < 2; i++)
+    {
+        scene.wavefront = MODES[i];
+        double best = 0.0;
+        for(uint32_t run = 0; run < RUNS; run++)
+        {
+            const double seconds = render(scene, camera, num_threads);
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+        if(i == 0)
+            per_path = best;
+        std::printf("[BENCH]     %-10s %8.3f Mpaths/s %7.2fx\n", NAMES[i],
+                    paths / best * 1e-6, per_path / best);
+    }
+    return 0;
+}
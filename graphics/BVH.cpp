@@ -0,0 +1,364 @@
+#include "BVH.h"
+
+#include <cfloat>
+#include <algorithm>
+
+#include "../util/ParallelFor.h"
+
+namespace
+{
+    constexpr uint32_t MAX_DEPTH = BVH::STACK_SIZE - 2;
+
+    // Below these many primitives, a thread of its own costs more than it saves
+    constexpr uint32_t PARALLEL_BUILD_MIN_PRIMS = 1 << 16;
+    constexpr uint32_t PARALLEL_BIN_MIN_PRIMS   = 1 << 16;
+    constexpr uint32_t BIN_SLICE_PRIMS          = 1 << 14;
+
+    struct Bin
+    {
+        AABB     bounds;
+        uint32_t count = 0;
+    };
+
+    // Bins along each axis, over the extent of the centroids
+    struct NodeBins
+    {
+        Bin bins[3][BVH::NUM_BINS];
+
+        void merge(const NodeBins& other)
+        {
+            for(int axis = 0; axis < 3; axis++)
+            {
+                for(uint32_t b = 0; b < BVH::NUM_BINS; b++)
+                {
+                    bins[axis][b].count += other.bins[axis][b].count;
+                    bins[axis][b].bounds.grow(other.bins[axis][b].bounds);
+                }
+            }
+        }
+    };
+
+    inline uint32_t bin_index(const scalar centroid, const scalar lo, const scalar scale)
+    {
+        return std::min(BVH::NUM_BINS - 1, uint32_t((centroid - lo) * scale));
+    }
+
+    void bin_primitives(const uint32_t*          prims,
+                        const uint32_t           count,
+                        const AABB&              centroid_bounds,
+                        const std::vector<AABB>& prim_bounds,
+                        const std::vector<Vec3>& centroids,
+                        NodeBins&                out)
+    {
+        for(int axis = 0; axis < 3; axis++)
+        {
+            const scalar lo = centroid_bounds.lower[axis];
+            const scalar hi = centroid_bounds.upper[axis];
+            if(!(hi > lo))
+                continue;
+
+            const scalar scale = scalar(BVH::NUM_BINS) / (hi - lo);
+            for(uint32_t i = 0; i < count; i++)
+            {
+                const uint32_t p = prims[i];
+                Bin& bin = out.bins[axis][bin_index(centroids[p][axis], lo, scale)];
+                bin.count++;
+                bin.bounds.grow(prim_bounds[p]);
+            }
+        }
+    }
+
+    /**
+     * Binning is most of the work near the root, where there are too few
+     * nodes to go around, so large nodes are binned a slice at a time
+     * by all threads instead
+     **/
+    void bin_node(const uint32_t*          prims,
+                  const uint32_t           count,
+                  const std::vector<AABB>& prim_bounds,
+                  const std::vector<Vec3>& centroids,
+                  const bool               parallel,
+                  AABB&                    centroid_bounds,
+                  NodeBins&                bins)
+    {
+        if(!parallel || count < PARALLEL_BIN_MIN_PRIMS)
+        {
+            for(uint32_t i = 0; i < count; i++)
+                centroid_bounds.grow(centroids[prims[i]]);
+            bin_primitives(prims, count, centroid_bounds, prim_bounds, centroids, bins);
+            return;
+        }
+
+        const uint32_t num_slices = (count + BIN_SLICE_PRIMS - 1) / BIN_SLICE_PRIMS;
+        std::vector<AABB> slice_bounds(num_slices);
+        parallel_for(num_slices, [&](uint32_t s) {
+            const uint32_t end = std::min(count, (s + 1) * BIN_SLICE_PRIMS);
+            for(uint32_t i = s * BIN_SLICE_PRIMS; i < end; i++)
+                slice_bounds[s].grow(centroids[prims[i]]);
+        });
+        for(const AABB& b : slice_bounds)
+            centroid_bounds.grow(b);
+
+        std::vector<NodeBins> slice_bins(num_slices);
+        parallel_for(num_slices, [&](uint32_t s) {
+            const uint32_t first = s * BIN_SLICE_PRIMS;
+            bin_primitives(prims + first, std::min(count - first, BIN_SLICE_PRIMS),
+                           centroid_bounds, prim_bounds, centroids, slice_bins[s]);
+        });
+        for(const NodeBins& b : slice_bins)
+            bins.merge(b);
+    }
+}
+
+void BVH::clear()
+{
+    nodes.clear();
+    prim_indices.clear();
+}
+
+void BVH::build(const std::vector<Primitive*>& primitives)
+{
+    std::vector<AABB> prim_bounds(primitives.size());
+    for(std::size_t i = 0; i < primitives.size(); i++)
+    {
+        const BoundsDefinition b = primitives[i]->get_bounds();
+        prim_bounds[i] = AABB(b.lower_far_corner, b.upper_near_corner);
+    }
+    build(prim_bounds);
+}
+
+void BVH::build(const std::vector<AABB>& prim_bounds, const uint32_t max_leaf_prims)
+{
+    clear();
+    if(prim_bounds.empty())
+        return;
+
+    const uint32_t num_prims = prim_bounds.size();
+
+    std::vector<Vec3> centroids(num_prims);
+
+    prim_indices.resize(num_prims);
+    for(uint32_t i = 0; i < num_prims; i++)
+    {
+        centroids[i]    = prim_bounds[i].centroid();
+        prim_indices[i] = i;
+    }
+
+    // A binary tree with N leaves never has more than 2N - 1 nodes
+    nodes.reserve(2 * num_prims - 1);
+    nodes.push_back(BVHNode{ AABB(), 0, num_prims });
+    update_node_bounds(nodes, 0, prim_bounds);
+
+    const uint32_t num_threads = hardware_threads();
+    if(num_threads == 1 || num_prims < PARALLEL_BUILD_MIN_PRIMS)
+    {
+        subdivide(nodes, 0, 0, prim_bounds, centroids, max_leaf_prims);
+        nodes.shrink_to_fit();
+        return;
+    }
+
+    // Split the top of the tree here until there are enough subtrees for
+    // the threads to build on their own, each over its own range of
+    // prim_indices and into its own nodes
+    std::vector<std::pair<uint32_t, uint32_t>> subtrees;
+    subdivide(nodes, 0, 0, prim_bounds, centroids, max_leaf_prims,
+              std::max(PARALLEL_BUILD_MIN_PRIMS / 4, num_prims / (8 * num_threads)), &subtrees);
+
+    // Largest first, so that no thread is left with a big one at the end
+    std::sort(subtrees.begin(), subtrees.end(), [&](const std::pair<uint32_t, uint32_t>& a,
+                                                    const std::pair<uint32_t, uint32_t>& b) {
+        return nodes[a.first].prim_count > nodes[b.first].prim_count;
+    });
+
+    std::vector<std::vector<BVHNode>> subtree_nodes(subtrees.size());
+    parallel_for(subtrees.size(), [&](uint32_t i) {
+        std::vector<BVHNode>& local = subtree_nodes[i];
+        local.reserve(2 * nodes[subtrees[i].first].prim_count - 1);
+        local.push_back(nodes[subtrees[i].first]);
+        subdivide(local, 0, subtrees[i].second, prim_bounds, centroids, max_leaf_prims);
+    });
+
+    // Append each subtree below its root, with its child links moved along
+    for(std::size_t i = 0; i < subtrees.size(); i++)
+    {
+        const std::vector<BVHNode>& local = subtree_nodes[i];
+        const uint32_t base = nodes.size() - 1;
+
+        auto relocate = [base](BVHNode node) {
+            if(!node.is_leaf())
+                node.left_first += base;
+            return node;
+        };
+        nodes[subtrees[i].first] = relocate(local[0]);
+        for(std::size_t j = 1; j < local.size(); j++)
+            nodes.push_back(relocate(local[j]));
+    }
+    nodes.shrink_to_fit();
+}
+
+void BVH::update_node_bounds(std::vector<BVHNode>& out_nodes, uint32_t node_idx, const std::vector<AABB>& prim_bounds) const
+{
+    BVHNode& node = out_nodes[node_idx];
+    node.bounds = AABB();
+    for(uint32_t i = 0; i < node.prim_count; i++)
+        node.bounds.grow(prim_bounds[prim_indices[node.left_first + i]]);
+}
+
+void BVH::subdivide(std::vector<BVHNode>& out_nodes,
+                    uint32_t root_idx,
+                    uint32_t root_depth,
+                    const std::vector<AABB>& prim_bounds,
+                    const std::vector<Vec3>& centroids,
+                    const uint32_t max_leaf_prims,
+                    const uint32_t subtree_prims,
+                    std::vector<std::pair<uint32_t, uint32_t>>* subtrees)
+{
+    // Explicit stack of (node, depth) pairs, so that degenerate inputs cannot
+    // overflow the call stack nor exceed the traversal stack in hit()
+    std::vector<std::pair<uint32_t, uint32_t>> pending = { { root_idx, root_depth } };
+
+    while(!pending.empty())
+    {
+        const uint32_t node_idx = pending.back().first;
+        const uint32_t depth    = pending.back().second;
+        pending.pop_back();
+
+        const uint32_t first = out_nodes[node_idx].left_first;
+        const uint32_t count = out_nodes[node_idx].prim_count;
+
+        if(count <= max_leaf_prims || depth >= MAX_DEPTH)
+            continue;
+
+        if(subtrees != nullptr && count <= subtree_prims)
+        {
+            subtrees->push_back({ node_idx, depth });
+            continue;
+        }
+
+        // Bin along the extent of the centroids rather than the node bounds,
+        // as the former is what actually separates the primitives
+        AABB     centroid_bounds;
+        NodeBins node_bins;
+        bin_node(prim_indices.data() + first, count, prim_bounds, centroids,
+                 subtrees != nullptr, centroid_bounds, node_bins);
+
+        scalar   best_cost = FLT_MAX;
+        int      best_axis = -1;
+        uint32_t best_bin  = 0;
+
+        for(int axis = 0; axis < 3; axis++)
+        {
+            if(!(centroid_bounds.upper[axis] > centroid_bounds.lower[axis]))
+                continue;
+
+            const Bin* bins = node_bins.bins[axis];
+
+            // Sweep from both sides to get the cost of each of the
+            // NUM_BINS - 1 candidate planes in linear time
+            scalar   left_area [NUM_BINS - 1], right_area [NUM_BINS - 1];
+            uint32_t left_count[NUM_BINS - 1], right_count[NUM_BINS - 1];
+
+            AABB left_box;
+            AABB right_box;
+            uint32_t left_sum  = 0;
+            uint32_t right_sum = 0;
+            for(uint32_t i = 0; i < NUM_BINS - 1; i++)
+            {
+                left_sum += bins[i].count;
+                left_box.grow(bins[i].bounds);
+                left_count[i] = left_sum;
+                left_area [i] = left_box.half_area();
+
+                right_sum += bins[NUM_BINS - 1 - i].count;
+                right_box.grow(bins[NUM_BINS - 1 - i].bounds);
+                right_count[NUM_BINS - 2 - i] = right_sum;
+                right_area [NUM_BINS - 2 - i] = right_box.half_area();
+            }
+
+            for(uint32_t i = 0; i < NUM_BINS - 1; i++)
+            {
+                if(left_count[i] == 0 || right_count[i] == 0)
+                    continue;
+                const scalar cost = left_count[i]  * left_area[i] +
+                                    right_count[i] * right_area[i];
+                if(cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin  = i;
+                }
+            }
+        }
+
+        // Only split if it is cheaper than intersecting everything in this node
+        const scalar leaf_cost = count * out_nodes[node_idx].bounds.half_area();
+        if(best_axis == -1 || best_cost >= leaf_cost)
+            continue;
+
+        // Partition the primitive indices in place about the chosen plane
+        const scalar lo    = centroid_bounds.lower[best_axis];
+        const scalar hi    = centroid_bounds.upper[best_axis];
+        const scalar scale = scalar(NUM_BINS) / (hi - lo);
+
+        uint32_t* begin = prim_indices.data() + first;
+        uint32_t* mid   = std::partition(begin, begin + count, [&](uint32_t p) {
+            return bin_index(centroids[p][best_axis], lo, scale) <= best_bin;
+        });
+        const uint32_t left_count = mid - begin;
+
+        if(left_count == 0 || left_count == count)
+            continue;
+
+        const uint32_t left_idx = out_nodes.size();
+        out_nodes.push_back(BVHNode{ AABB(), first, left_count });
+        out_nodes.push_back(BVHNode{ AABB(), first + left_count, count - left_count });
+        update_node_bounds(out_nodes, left_idx,     prim_bounds);
+        update_node_bounds(out_nodes, left_idx + 1, prim_bounds);
+
+        out_nodes[node_idx].left_first = left_idx;
+        out_nodes[node_idx].prim_count = 0;
+
+        pending.push_back({ left_idx,     depth + 1 });
+        pending.push_back({ left_idx + 1, depth + 1 });
+    }
+}
+
+bool BVH::occluded(const std::vector<Primitive*>& primitives,
+                   const Ray&   r,
+                   const scalar t_min,
+                   const scalar t_max) const
+{
+    return traverse_any(r, t_min, t_max, [&](const BVHNode& leaf) {
+        for(uint32_t i = 0; i < leaf.prim_count; i++)
+        {
+            if(primitives[prim_indices[leaf.left_first + i]]->occluded(r, t_min, t_max))
+                return true;
+        }
+        return false;
+    });
+}
+
+bool BVH::hit(const std::vector<Primitive*>& primitives,
+              const Ray&   r,
+              const scalar t_min,
+              const scalar t_max,
+              HitRecord&   rec) const
+{
+    HitRecord temp_rec = {};
+    scalar closest     = t_max;
+
+    return traverse(r, t_min, closest, [&](const BVHNode& leaf, scalar& nearest) {
+        bool hit_leaf = false;
+        for(uint32_t i = 0; i < leaf.prim_count; i++)
+        {
+            const Primitive* prim = primitives[prim_indices[leaf.left_first + i]];
+            if(prim->hit(r, t_min, nearest, temp_rec))
+            {
+                nearest  = temp_rec.t;
+                rec      = temp_rec;
+                hit_leaf = true;
+            }
+        }
+        return hit_leaf;
+    });
+}
@@ -0,0 +1,265 @@
+#ifndef GRAPHICS_BVH_H
+#define GRAPHICS_BVH_H
+
+#include "Primitive.h"
+#include "RayPacket.h"
+#include "../math/AABB.h"
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+/**
+ * A single node of the flattened hierarchy. Interior nodes have a
+ * prim_count of 0 and their children are stored next to each other,
+ * starting at left_first. Leaf nodes instead refer to prim_count
+ * entries of BVH::prim_indices starting at left_first.
+ **/
+struct BVHNode
+{
+    AABB     bounds;
+    uint32_t left_first;
+    uint32_t prim_count;
+
+    inline bool is_leaf() const { return prim_count > 0; }
+};
+
+/**
+ * Bounding volume hierarchy over a list of primitives, built with
+ * binned surface area heuristic from Primitive::get_bounds(). The
+ * primitives themselves are not owned, only referred to by index.
+ * Large hierarchies are built on all hardware threads, the top levels
+ * binning in parallel and the subtrees below them built as separate tasks.
+ *
+ * It may also be built over plain bounding boxes, in which case the
+ * owner interprets the leaves itself through traverse()
+ **/
+class BVH {
+public:
+    static constexpr uint32_t NUM_BINS       = 12;
+    static constexpr uint32_t MAX_LEAF_PRIMS = 4;
+    static constexpr uint32_t STACK_SIZE     = 64;
+
+    void build(const std::vector<Primitive*>& primitives);
+    void build(const std::vector<AABB>& prim_bounds, const uint32_t max_leaf_prims = MAX_LEAF_PRIMS);
+    void clear();
+
+    bool hit(const std::vector<Primitive*>& primitives,
+             const Ray&   r,
+             const scalar t_min,
+             const scalar t_max,
+             HitRecord&   rec) const;
+
+    /**
+     * Visits the leaves pierced by the ray, nearest first. intersect_leaf
+     * is called as bool(const BVHNode& leaf, scalar& closest) and must 
+     * lower closest and return true whenever it finds a nearer hit
+     **/
+    template <typename LeafFunction>
+    bool traverse(const Ray& r, const scalar t_min, scalar& closest, LeafFunction&& intersect_leaf) const;
+
+    bool occluded(const std::vector<Primitive*>& primitives,
+                  const Ray&   r,
+                  const scalar t_min,
+                  const scalar t_max) const;
+
+    /**
+     * Visits the leaves pierced by the ray in no particular order, until
+     * occluded_leaf, called as bool(const BVHNode& leaf), returns true
+     **/
+    template <typename LeafFunction>
+    bool traverse_any(const Ray& r, const scalar t_min, const scalar t_max, LeafFunction&& occluded_leaf) const;
+
+    /**
+     * Visits the leaves pierced by any ray of the packet, roughly nearest
+     * first, culling whole subtrees by interval arithmetic on the packet
+     * before testing its rays. intersect_leaf is called as
+     * void(const BVHNode& leaf, const uint32_t* active, uint32_t num_active)
+     * with the rays which enter the leaf, and must lower the packet's t_max
+     * of those it finds nearer hits for. Rays before first_active are left
+     * out altogether
+     **/
+    template <typename LeafFunction>
+    void traverse_packet(const RayPacket& packet, const scalar t_min, const uint32_t first_active,
+                         LeafFunction&& intersect_leaf) const;
+
+    inline bool empty() const { return nodes.empty(); }
+
+    // Bounds of everything in the hierarchy
+    inline AABB bounds() const { return nodes.empty() ? AABB() : nodes[0].bounds; }
+
+    std::vector<BVHNode>  nodes;
+    std::vector<uint32_t> prim_indices;
+private:
+    /**
+     * Splits the node at root_idx of out_nodes, which is either nodes or
+     * a subtree being built apart from it, and everything below it. Given
+     * subtrees, nodes with at most subtree_prims primitives are left as
+     * they are and recorded there along with their depth instead
+     **/
+    void subdivide(std::vector<BVHNode>& out_nodes,
+                   uint32_t root_idx,
+                   uint32_t root_depth,
+                   const std::vector<AABB>& prim_bounds,
+                   const std::vector<Vec3>& centroids,
+                   const uint32_t max_leaf_prims,
+                   const uint32_t subtree_prims = 0,
+                   std::vector<std::pair<uint32_t, uint32_t>>* subtrees = nullptr);
+    void update_node_bounds(std::vector<BVHNode>& out_nodes,
+                            uint32_t node_idx,
+                            const std::vector<AABB>& prim_bounds) const;
+};
+
+template <typename LeafFunction>
+bool BVH::traverse(const Ray& r, const scalar t_min, scalar& closest, LeafFunction&& intersect_leaf) const
+{
+    if(nodes.empty())
+        return false;
+
+    const RayInverse ri(r);
+    bool hit_anything = false;
+
+    struct StackEntry
+    {
+        uint32_t node_idx;
+        scalar   t_enter;
+    };
+
+    StackEntry stack[STACK_SIZE];
+    uint32_t   stack_ptr = 0;
+
+    scalar t_enter = 0.0f, t_exit = 0.0f;
+    if(!nodes[0].bounds.intersect(ri, t_min, closest, t_enter, t_exit))
+        return false;
+    stack[stack_ptr++] = { 0, t_enter };
+
+    while(stack_ptr > 0)
+    {
+        const StackEntry entry = stack[--stack_ptr];
+
+        // A hit found since this node was pushed may already be nearer
+        if(entry.t_enter > closest)
+            continue;
+
+        const BVHNode& node = nodes[entry.node_idx];
+
+        if(node.is_leaf())
+        {
+            if(intersect_leaf(node, closest))
+                hit_anything = true;
+            continue;
+        }
+
+        // Visit the nearer child first so that closest shrinks sooner
+        StackEntry near_child = { node.left_first,     0.0f };
+        StackEntry far_child  = { node.left_first + 1, 0.0f };
+
+        const bool hit_near = nodes[near_child.node_idx].bounds.intersect(ri, t_min, closest, near_child.t_enter, t_exit);
+        const bool hit_far  = nodes[far_child.node_idx ].bounds.intersect(ri, t_min, closest, far_child.t_enter,  t_exit);
+
+        if(hit_near && hit_far)
+        {
+            if(far_child.t_enter < near_child.t_enter)
+                std::swap(near_child, far_child);
+            stack[stack_ptr++] = far_child;
+            stack[stack_ptr++] = near_child;
+        }
+        else if(hit_near)
+            stack[stack_ptr++] = near_child;
+        else if(hit_far)
+            stack[stack_ptr++] = far_child;
+    }
+    return hit_anything;
+}
+
+template <typename LeafFunction>
+void BVH::traverse_packet(const RayPacket& packet, const scalar t_min, const uint32_t first_active,
+                          LeafFunction&& intersect_leaf) const
+{
+    if(nodes.empty() || first_active >= packet.count)
+        return;
+
+    // Rays which missed a node miss everything below it too, so the first
+    // ray still active is passed down along with each node
+    struct StackEntry
+    {
+        uint32_t node_idx;
+        uint32_t first_active;
+    };
+
+    StackEntry stack[STACK_SIZE];
+    uint32_t   stack_ptr = 0;
+    stack[stack_ptr++] = { 0, first_active };
+
+    while(stack_ptr > 0)
+    {
+        const StackEntry entry = stack[--stack_ptr];
+        const BVHNode&   node  = nodes[entry.node_idx];
+
+        if(!packet.may_hit(node.bounds, t_min))
+            continue;
+
+        const uint32_t first = packet.first_hit(node.bounds, t_min, entry.first_active);
+        if(first == packet.count)
+            continue;
+
+        if(node.is_leaf())
+        {
+            uint32_t active[RayPacket::MAX_SIZE];
+            const uint32_t num_active = packet.active_rays(node.bounds, t_min, first, active);
+            intersect_leaf(node, static_cast<const uint32_t*>(active), num_active);
+            continue;
+        }
+
+        // Visit first the child which the first active ray reaches first,
+        // going by the axis along which the children are furthest apart
+        const Vec3 left_center  = nodes[node.left_first    ].bounds.centroid();
+        const Vec3 right_center = nodes[node.left_first + 1].bounds.centroid();
+        const Vec3 separation   = right_center - left_center;
+
+        int axis = std::fabs(separation.x()) > std::fabs(separation.y()) ? 0 : 1;
+        if(std::fabs(separation.z()) > std::fabs(separation[axis]))
+            axis = 2;
+
+        const scalar dir = axis == 0 ? packet.dir_x[first] : (axis == 1 ? packet.dir_y[first] : packet.dir_z[first]);
+        const bool   left_first = (dir >= 0) == (separation[axis] >= 0);
+
+        stack[stack_ptr++] = { left_first ? node.left_first + 1 : node.left_first,     first };
+        stack[stack_ptr++] = { left_first ? node.left_first     : node.left_first + 1, first };
+    }
+}
+
+template <typename LeafFunction>
+bool BVH::traverse_any(const Ray& r, const scalar t_min, const scalar t_max, LeafFunction&& occluded_leaf) const
+{
+    if(nodes.empty())
+        return false;
+
+    const RayInverse ri(r);
+
+    uint32_t stack[STACK_SIZE];
+    uint32_t stack_ptr = 0;
+    stack[stack_ptr++] = 0;
+
+    scalar t_enter = 0.0f, t_exit = 0.0f;
+    while(stack_ptr > 0)
+    {
+        const BVHNode& node = nodes[stack[--stack_ptr]];
+
+        if(!node.bounds.intersect(ri, t_min, t_max, t_enter, t_exit))
+            continue;
+
+        if(node.is_leaf())
+        {
+            if(occluded_leaf(node))
+                return true;
+            continue;
+        }
+
+        stack[stack_ptr++] = node.left_first + 1;
+        stack[stack_ptr++] = node.left_first;
+    }
+    return false;
+}
+
+#endif
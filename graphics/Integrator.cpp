@@ -0,0 +1,114 @@
+#include "Integrator.h"
+
+#include <algorithm>
+
+scalar power_heuristic(const scalar pdf_a, const scalar pdf_b)
+{
+    const scalar a2 = pdf_a * pdf_a;
+    const scalar b2 = pdf_b * pdf_b;
+    return a2 / (a2 + b2);
+}
+
+Color background(const Ray& r)
+{
+    // Comment for ambient background
+    Vector unit_dir = normalize(r.direction());
+    float t = 0.5 * (unit_dir.y() + 1.0f);
+    return (1.0 - t) * Vec3({1.0, 1.0, 1.0}) + t * Vec3({0.5, 0.7, 1.0});
+    //return world.ambient;
+}
+
+Color direct_light(const HitRecord& rec, const Scene& world)
+{
+    Vec3   light_dir;
+    Color  light_emitted;
+    scalar light_pdf = 0.0f;
+    if(!world.sample_light(rec.point_at_t, light_dir, light_emitted, light_pdf))
+        return Color({ 0.0, 0.0, 0.0 });
+
+    const scalar bsdf_pdf = rec.material_ptr->pdf(rec, light_dir);
+    if(bsdf_pdf <= 0)
+        return Color({ 0.0, 0.0, 0.0 });
+
+    const Color f = rec.material_ptr->evaluate(rec, light_dir);
+    return f * light_emitted * (power_heuristic(light_pdf, bsdf_pdf) / light_pdf);
+}
+
+bool survives_roulette(const uint32_t depth, const Scene& world, Color& throughput)
+{
+    if(depth < world.russian_roulette_depth)
+        return true;
+
+    const scalar survival = clamp(std::max({ throughput.r(), throughput.g(), throughput.b() }), 
+                                  0.05f, 1.0f);
+    if(random_scalar() >= survival)
+        return false;
+    throughput /= survival;
+    return true;
+}
+
+Color color(const Ray& primary_ray, const Scene& world)
+{
+    HitRecord  rec = {};
+    const bool hit = world.anything_hit(primary_ray, 1e-3, FLT_MAX, rec);
+    return color(primary_ray, hit, rec, world);
+}
+
+Color color(const Ray& primary_ray, const bool primary_hit, const HitRecord& primary_rec, const Scene& world)
+{
+    Ray   r          = primary_ray;
+    Color radiance   = Color({ 0.0, 0.0, 0.0 });
+    Color throughput = Color({ 1.0, 1.0, 1.0 });
+
+    // pdf of the last scattered direction, 0 for camera rays and for
+    // materials that are not light sampled, whose hits count in full
+    scalar scatter_pdf = 0.0f;
+    Vec3   scatter_origin;
+
+    // Ray cone of the pixel, whose width at each hit selects the level of
+    // detail of textures. Its spread is kept as it is at every bounce
+    const scalar cone_spread = world.pixel_spread_angle();
+    scalar       cone_width  = 0.0f;
+
+    for(uint32_t depth = 0; ; depth++)
+    {
+        HitRecord  rec = depth == 0 ? primary_rec : HitRecord {};
+        const bool hit = depth == 0 ? primary_hit : world.anything_hit(r, 1e-3, FLT_MAX, rec);
+        if(!hit)
+        {
+            radiance += throughput * background(r);
+            break;
+        }
+
+        if(depth > world.max_recursion_depth)
+            break;
+
+        cone_width    += cone_spread * rec.t * r.direction().magnitude();
+        rec.cone_width = cone_width;
+
+        Ray   scattered;
+        Color attenuation;
+
+        // A light found by scattering may also have been sampled directly
+        // from the previous bounce, so both estimates are weighted (MIS)
+        Color emitted = rec.material_ptr->emitted(rec.uv);
+        if(scatter_pdf > 0 && world.sample_lights)
+            emitted *= power_heuristic(scatter_pdf, world.light_pdf(scatter_origin, rec));
+        radiance += throughput * emitted;
+
+        if(!rec.material_ptr->scatter(r, rec, attenuation, scattered))
+            break;
+
+        if(world.sample_lights && rec.material_ptr->is_light_sampled())
+            radiance += throughput * direct_light(rec, world);
+
+        scatter_origin = rec.point_at_t;
+        scatter_pdf    = rec.material_ptr->pdf(rec, normalize(scattered.direction()));
+        throughput     = throughput * attenuation;
+
+        if(!survives_roulette(depth, world, throughput))
+            break;
+        r = scattered;
+    }
+    return radiance;
+}
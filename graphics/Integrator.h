@@ -0,0 +1,39 @@
+#ifndef GRAPHICS_INTEGRATOR_H
+#define GRAPHICS_INTEGRATOR_H
+
+#include "Scene.h"
+
+// Weight of a sample taken with pdf_a, when pdf_b could also have produced it
+scalar power_heuristic(const scalar pdf_a, const scalar pdf_b);
+
+// Radiance from the sky, arriving along rays which hit nothing
+Color background(const Ray& r);
+
+/**
+ * Next event estimation at a hit, i.e. the radiance reflected towards the
+ * ray which comes from one of the lights, picked at random, weighted
+ * against finding it through scatter() (MIS). To be scaled by throughput.
+ * Only worth calling on materials which are is_light_sampled()
+ **/
+Color direct_light(const HitRecord& rec, const Scene& world);
+
+/**
+ * Russian roulette, past world.russian_roulette_depth paths which can no
+ * longer contribute much are ended at random, returning false, and the
+ * survivors' throughput is boosted to stay unbiased
+ **/
+bool survives_roulette(const uint32_t depth, const Scene& world, Color& throughput);
+
+/**
+ * Radiance arriving along primary_ray, estimated by a single path with
+ * next event estimation at diffuse bounces and Russian roulette
+ **/
+Color color(const Ray& primary_ray, const Scene& world);
+
+/**
+ * The same, given what primary_ray hits, if anything, as found e.g. by
+ * tracing it in a packet along with others
+ **/
+Color color(const Ray& primary_ray, const bool primary_hit, const HitRecord& primary_rec, const Scene& world);
+
+#endif
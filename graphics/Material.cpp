@@ -1,19 +1,54 @@
 #include "Material.h"
 
+/**
+ * Scatters each path of the batch off material, through T::scatter()
+ * named outright so that the call is not virtual
+ **/
+template<typename T>
+static void scatter_each(const T& material, const ScatterBatch& batch)
+{
+    Sampler& sampler = Sampler::current();
+    for(uint32_t k = 0; k < batch.num_paths; k++)
+    {
+        const uint32_t i = batch.paths[k];
+        sampler.resume_sample(batch.samples[i]);
+        batch.scatters[i] = material.T::scatter(batch.rays[i], batch.recs[i], batch.attenuation[i], batch.scattered[i]);
+        batch.samples[i]  = sampler.suspend_sample();
+    }
+}
+
+void Material::scatter_batch(const ScatterBatch& batch) const
+{
+    Sampler& sampler = Sampler::current();
+    for(uint32_t k = 0; k < batch.num_paths; k++)
+    {
+        const uint32_t i = batch.paths[k];
+        sampler.resume_sample(batch.samples[i]);
+        batch.scatters[i] = scatter(batch.rays[i], batch.recs[i], batch.attenuation[i], batch.scattered[i]);
+        batch.samples[i]  = sampler.suspend_sample();
+    }
+}
+
 Vec3 Material::emitted(const Vec2&) const
 {
     return Vec3({0.0, 0.0, 0.0});
 }
 
+Vec3 Material::evaluate(const HitRecord&, const Vec3&) const
+{
+    return Vec3({0.0, 0.0, 0.0});
+}
+
+scalar Material::pdf(const HitRecord&, const Vec3&) const
+{
+    return 0.0f;
+}
+
 Vec3 Textured::emitted(const Vec2& uv) const 
 {
     if(!is_emissive)
         return Vec3({ 0.0, 0.0, 0.0 });
-
-    Vec2 texel   = Vec2({ std::floor(uv.u() * scalar(image_width  - 1)) , 
-                          std::floor(uv.v() * scalar(image_height - 1)) });
-    uint32_t idx = uint32_t(texel.v() * scalar(image_width) + texel.u());
-    return albedo_map[ idx ];
+    return albedo_map->sample(uv, 0.0f);
 }
 
 bool Textured::scatter(const Ray& r, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const 
@@ -21,57 +56,21 @@ bool Textured::scatter(const Ray& r, const HitRecord& rec, Vec3& attenuation, Ra
     if(is_emissive)
         return false;
 
-    // Get texel (U, V) from the UV coordinates
-    Vec2 texel   = Vec2({ std::floor(rec.uv.u() * scalar(image_width  - 1)), 
-                          std::floor(rec.uv.v() * scalar(image_height - 1)) });
-    uint32_t idx = uint32_t(texel.v() * scalar(image_width) + texel.u());
-
-    // Bilinear Interpolation
-    Vec2 t1 = Vec2({ std::floor(rec.uv.u() * scalar(image_width  - 1)), 
-                     std::floor(rec.uv.v() * scalar(image_height - 1)) });
-    Vec2 t2 = Vec2({ std::ceil (rec.uv.u() * scalar(image_width  - 1)), 
-                     std::floor(rec.uv.v() * scalar(image_height - 1)) });
-    Vec2 t3 = Vec2({ std::floor(rec.uv.u() * scalar(image_width  - 1)), 
-                     std::ceil (rec.uv.v() * scalar(image_height - 1)) });
-    Vec2 t4 = Vec2({ std::ceil (rec.uv.u() * scalar(image_width  - 1)), 
-                     std::ceil (rec.uv.v() * scalar(image_height - 1)) });
-
-    int idx1 = clamp(int(t1.v() * image_width + t1.u() - 1), 0, int(image_width * image_height - 1));
-    int idx2 = clamp(int(t2.v() * image_width + t2.u() + 1), 0, int(image_width * image_height - 1));
-    int idx3 = clamp(int(t3.v() * image_width + t3.u() + image_width), 0, int(image_width * image_height - 1));
-    int idx4 = clamp(int(t4.v() * image_width + t4.u() - image_width), 0, int(image_width * image_height - 1));
-
-    scalar x_interp = rec.uv.u() * image_width  - t1.u();
-    scalar y_interp = rec.uv.v() * image_height - t1.v();
-
-    Vec3 tex1 = albedo_map[idx1];
-    Vec3 tex2 = albedo_map[idx2];
-    Vec3 tex3 = albedo_map[idx3];
-    Vec3 tex4 = albedo_map[idx4];
-
-    Vec3 a1  = (1.0 - x_interp) * tex1 + (x_interp * tex2);
-    Vec3 a2  = (1.0 - x_interp) * tex3 + (x_interp * tex4);
-    Vec3 att_filtered = (1.0 - y_interp) * a1  + (y_interp * a2);
+    // Footprint of the ray cone in texture space, which grows as the 
+    // surface is seen at a grazing angle
+    const Vec3   direction = normalize(r.direction());
+    const scalar cosine    = std::fabs(dot(direction, normalize(rec.normal)));
+    const scalar footprint = rec.cone_width * std::sqrt(rec.uv_density) / std::max(cosine, 0.05f);
 
-    // Normal map
-    Vec3 reflected    = reflect(normalize(r.direction()), rec.normal) + random_in_unit_sphere();
-    Vec3 final_normal = rec.normal;
+    attenuation = albedo_map->sample(rec.uv, footprint);
 
-    // TODO: Option for bilinear filtering on image
-    attenuation = att_filtered;
+    // Normal map
+    Vec3   final_normal = rec.normal;
+    scalar roughness    = 1.0f;
 
     if(normal_map != nullptr)
     {
-        Vec3 texn1 = normal_map[idx1];
-        Vec3 texn2 = normal_map[idx2];
-        Vec3 texn3 = normal_map[idx3];
-        Vec3 texn4 = normal_map[idx4];
-
-        Vec3 n1  = (1.0 - x_interp) * texn1 + (x_interp * texn2);
-        Vec3 n2  = (1.0 - x_interp) * texn3 + (x_interp * texn4);
-        Vec3 norm_interp = (1.0 - y_interp) * n1  + (y_interp * n2);
-
-        Vec3 tex_normal = norm_interp;
+        Vec3 tex_normal = normal_map->sample(rec.uv, footprint);
 
         // TODO: Calculate TBN
         final_normal = normalize(Vec3({
@@ -80,21 +79,38 @@ bool Textured::scatter(const Ray& r, const HitRecord& rec, Vec3& attenuation, Ra
                     dot(tex_normal, Vec3({rec.tangent.z(), rec.bitangent.z(), rec.normal.z()}))
                 }));
 
-        Vec3 rough_texel     = Vec3({ 0.0, 0.0, 0.0  });
-        Vec3 occlusion_texel = Vec3({ 1.0, 1.0, 1.0  });
+        scalar rough_texel     = 0.0f;
+        scalar occlusion_texel = 1.0f;
 
         if(roughness_map)
-            rough_texel = roughness_map[idx];
+            rough_texel = roughness_map->sample_value(rec.uv, footprint);
         if(ambient_occlusion_map)
-            occlusion_texel = ambient_occlusion_map[idx];
+            occlusion_texel = ambient_occlusion_map->sample_value(rec.uv, footprint);
 
-        attenuation = albedo_map[idx] * occlusion_texel;
-        reflected   = reflect(normalize(r.direction()), rec.normal) + (rough_texel * random_in_unit_sphere());
+        attenuation = attenuation * occlusion_texel;
+        roughness   = rough_texel;
     }
-    scattered = Ray(rec.point_at_t, reflected);
+
+    // Reflect off a microfacet drawn from the GGX normals which the ray can
+    // see, with alpha = roughness^2 as is usual for roughness maps
+    const Vec3   normal = normalize(rec.normal);
+    const Frame  frame(normal);
+    const Vec3   wo     = frame.to_local(-direction);
+    const scalar alpha  = roughness * roughness;
+
+    Vec3 microfacet = normal;
+    if(alpha > 1e-4f && wo.z() > 0)
+        microfacet = frame.to_world(sample_ggx_vndf(wo, alpha, random_2d()));
+
+    scattered = Ray(rec.point_at_t, reflect(direction, microfacet));
     return true;
 }
 
+void Textured::scatter_batch(const ScatterBatch& batch) const
+{
+    scatter_each(*this, batch);
+}
+
 Vec3 Emissive::emitted(const Vec2&) const 
 {
     return color;
@@ -106,14 +122,38 @@ bool Emissive::scatter(const Ray&, const HitRecord&, Vec3&, Ray&)
     return false;
 }
 
+void Emissive::scatter_batch(const ScatterBatch& batch) const
+{
+    scatter_each(*this, batch);
+}
+
 bool Lambertian::scatter(const Ray&, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const 
 {
-    Vec3 target = rec.point_at_t + rec.normal + random_in_unit_sphere();
-    scattered   = Ray(rec.point_at_t, target - rec.point_at_t);
+    // Cosine distributed, so attenuation = BRDF * cos / pdf is just the albedo
+    const Frame frame(normalize(rec.normal));
+    scattered   = Ray(rec.point_at_t, frame.to_world(sample_cosine_hemisphere(random_2d())));
     attenuation = albedo;
     return true;
 }
 
+void Lambertian::scatter_batch(const ScatterBatch& batch) const
+{
+    scatter_each(*this, batch);
+}
+
+Vec3 Lambertian::evaluate(const HitRecord& rec, const Vec3& wi) const
+{
+    const scalar cosine = dot(normalize(rec.normal), wi);
+    if(cosine <= 0)
+        return Vec3({0.0, 0.0, 0.0});
+    return albedo * (cosine / k_PI);
+}
+
+scalar Lambertian::pdf(const HitRecord& rec, const Vec3& wi) const
+{
+    return cosine_hemisphere_pdf(dot(normalize(rec.normal), wi));
+}
+
 bool Metal::scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const 
 {
     Vec3 reflected = reflect(normalize(ray_in.direction()), rec.normal);
@@ -122,6 +162,11 @@ bool Metal::scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuation,
     return true;
 }
 
+void Metal::scatter_batch(const ScatterBatch& batch) const
+{
+    scatter_each(*this, batch);
+}
+
 bool Dielectric::scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const
 {
     Vec3  nrm = Vec3({0.0, 0.0, 0.0});
@@ -156,3 +201,8 @@ bool Dielectric::scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuat
     }
     return true;
 }
+
+void Dielectric::scatter_batch(const ScatterBatch& batch) const
+{
+    scatter_each(*this, batch);
+}
@@ -3,16 +3,12 @@
 
 #include "../util/General.h"
 #include "../math/Vector.h"
+#include "../math/Sampling.h"
 #include "../math/Ray.h"
+#include "Texture.h"
 
 #include <memory>
 
-// TODO: Make Textured material have this as an additional option
-enum class FilteringMethod {
-    NEAREST_NEIGHBOR,
-    BILINEAR,
-};
-
 inline double schlick_approx(const double IOR, const double cosine)
 {
     double R0 = std::pow<double>((1 - IOR) / (1 + IOR), 2);
@@ -20,6 +16,7 @@ inline double schlick_approx(const double IOR, const double cosine)
 }
 
 class Material;
+class Primitive;
 
 struct HitRecord 
 {
@@ -31,12 +28,63 @@ struct HitRecord
 
     Vec3 tangent;
     Vec3 bitangent;
+
+    // The primitive that was hit, used to look up its light sampling pdf
+    const Primitive* primitive;
+
+    /**
+     * For texture filtering, the area of texture space per unit of surface
+     * area around the hit (0 if unknown), and the width of the ray cone,
+     * i.e. of the pixel's footprint, by the time it reached the hit
+     **/
+    scalar uv_density;
+    scalar cone_width;
+};
+
+/**
+ * Hits of many paths to scatter at once, all on the same material. The
+ * arrays are indexed by path, of which the num_paths listed in paths are
+ * to be scattered, each within its own sample of the Sampler. scatters
+ * receives what scatter() returns
+ **/
+struct ScatterBatch
+{
+    const uint32_t*       paths;
+    uint32_t              num_paths;
+    const Ray*            rays;
+    const HitRecord*      recs;
+    Sampler::SampleState* samples;
+    Vec3*                 attenuation;
+    Ray*                  scattered;
+    uint8_t*              scatters;
 };
 
 class Material {
 public:
     virtual bool scatter(const Ray&, const HitRecord&, Vec3&, Ray&)  const = 0;
+    /**
+     * scatter() for every path of the batch. Materials override it to call
+     * their own scatter() directly, which then is inlined into the loop
+     * rather than dispatched hit by hit
+     **/
+    virtual void scatter_batch(const ScatterBatch& batch) const;
     virtual Vec3 emitted(const Vec2& uv) const;
+    virtual bool emits_light() const { return false; }
+
+    /**
+     * For materials whose scatter() can be combined with light sampling,
+     * BRDF * cos(theta) towards the unit direction wi, and the pdf with
+     * which scatter() picks wi. A pdf of 0 marks the materials which are
+     * only ever sampled through scatter(), e.g. mirrors and glass
+     **/
+    virtual Vec3   evaluate(const HitRecord& rec, const Vec3& wi) const;
+    virtual scalar pdf     (const HitRecord& rec, const Vec3& wi) const;
+
+    /**
+     * Whether pdf() can be above 0, i.e. whether sampling a light from a
+     * hit is worth its shadow ray. Only true where pdf() is implemented
+     **/
+    virtual bool is_light_sampled() const { return false; }
     virtual ~Material()
     {
     }
@@ -46,35 +94,36 @@ public:
 // TODO: textured
 class Textured : public Material {
 public:
-    Textured(Color*   albedo_map, 
-             Color*   normal_map,
-             Color*   ao_map,
-             Color*   rough_map,
-             bool     is_emissive,
-             uint32_t image_width,
-             uint32_t image_height):
+    /**
+     * Maps are filtered trilinearly, at the level of detail given by the
+     * ray cone footprint of the hit. The roughness and occlusion maps are
+     * single-channel
+     **/
+    Textured(const Texture* albedo_map, 
+             const Texture* normal_map,
+             const Texture* ao_map,
+             const Texture* rough_map,
+             bool           is_emissive):
         albedo_map  (albedo_map),
         normal_map  (normal_map),
         ambient_occlusion_map(ao_map),
         roughness_map(rough_map),
-        is_emissive (is_emissive),
-        image_width (image_width),
-        image_height(image_height)
+        is_emissive (is_emissive)
     {
         assert(albedo_map != nullptr);
     }
 
     virtual Vec3 emitted(const Vec2& uv) const override;
+    virtual bool emits_light() const override { return is_emissive; }
     virtual bool scatter(const Ray& r, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override;
+    virtual void scatter_batch(const ScatterBatch& batch) const override;
 private:
-    Color* albedo_map  = nullptr;
-    Color* normal_map  = nullptr;
-    Color* ambient_occlusion_map = nullptr;
-    Color* roughness_map         = nullptr;
-
-    bool     is_emissive;
-    uint32_t image_width;
-    uint32_t image_height;
+    const Texture* albedo_map  = nullptr;
+    const Texture* normal_map  = nullptr;
+    const Texture* ambient_occlusion_map = nullptr;
+    const Texture* roughness_map         = nullptr;
+
+    bool is_emissive;
 };
 
 class Emissive : public Material {
@@ -86,8 +135,10 @@ public:
     }
 
     virtual Vec3 emitted(const Vec2& uv) const override;
+    virtual bool emits_light() const override { return true; }
     virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuation, Ray& scattered)
         const override;
+    virtual void scatter_batch(const ScatterBatch& batch) const override;
     Vec3 color;
 };
 
@@ -97,6 +148,10 @@ public:
         albedo(attenuation) { }
 
     virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override;
+    virtual void scatter_batch(const ScatterBatch& batch) const override;
+    virtual Vec3   evaluate(const HitRecord& rec, const Vec3& wi) const override;
+    virtual scalar pdf     (const HitRecord& rec, const Vec3& wi) const override;
+    virtual bool   is_light_sampled() const override { return true; }
     Vec3 albedo;
 };
 
@@ -111,6 +166,7 @@ public:
     }
 
     virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override;
+    virtual void scatter_batch(const ScatterBatch& batch) const override;
     Vec3 albedo;
     float   fuzziness;
 };
@@ -126,6 +182,7 @@ public:
     {
     }
     virtual bool scatter(const Ray& ray_in, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override;
+    virtual void scatter_batch(const ScatterBatch& batch) const override;
     Vec3 albedo;
     float rel_ior;
     float fuzziness = 0.0;
@@ -2,8 +2,9 @@
 #define GRAPHICS_MESH_H
 
 #include "Triangle.h"
-#include "Rectangle3D.h"
 #include "Primitive.h"
+#include "BVH.h"
+#include "../math/AABB.h"
 
 #include <vector>
 #include <cfloat>
@@ -15,30 +16,36 @@
 
 struct Mesh
 {
-    Mesh();
+    Mesh() = default;
 
     void reserve_n_primitives(size_t n);
 
     /**
      * Adds a primitive to the collection of primitives to render
-     * Memory ownership must be transferred to the Mesh object
+     * Memory ownership must be transferred to the Mesh object.
+     * add_primitive also grows the bounds to enclose it
      **/
     void add_primitive(Primitive* p);
     void add_primitive_no_recalc(Primitive* p);
 
     /**
-     * Determines the axis-aligned bounding box, composed of 6
-     * Rectangle3D's which encloses all of the primitives of this
-     * mesh
+     * Determines the axis-aligned bounding box which encloses all
+     * of the primitives of this mesh
      **/
-    void calculate_bounding_faces();
+    void calculate_bounds();
+
+    /**
+     * (Re)builds the bounding volume hierarchy over the primitives,
+     * must be called once all of the primitives have been added
+     **/
+    void build_bvh();
 
     ~Mesh();
 
     std::vector<Material* > materials;
     std::vector<Primitive*> primitives;
-    std::vector<Primitive*> bounding_volume_faces;
-    Material* bv_mat;
+    AABB bounds;
+    BVH  bvh;
 };
 
 #endif
@@ -0,0 +1,233 @@
+#include "MeshCache.h"
+#include "../util/MappedFile.h"
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <type_traits>
+
+namespace
+{
+    constexpr uint32_t MESH_CACHE_MAGIC   = 0x434D5452;   // "RTMC" read as little endian
+    constexpr uint32_t MESH_CACHE_VERSION = 1;
+
+    static_assert(std::is_trivially_copyable<Vec3>::value,          "Vec3 is copied as bytes");
+    static_assert(std::is_trivially_copyable<BVHNode>::value,       "BVHNode is copied as bytes");
+    static_assert(std::is_trivially_copyable<TriangleBlock>::value, "TriangleBlock is copied as bytes");
+
+    struct SourceInfo
+    {
+        uint64_t size  = 0;
+        int64_t  mtime = 0;
+    };
+
+    bool source_info(const std::string& path, SourceInfo& info)
+    {
+        std::error_code error;
+        info.size  = std::filesystem::file_size(path, error);
+        if(error)
+            return false;
+        info.mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        return !error;
+    }
+
+    // FNV-1a over 8 bytes at a time, fast enough to not hold up loading
+    uint64_t hash_bytes(const char* data, const std::size_t size)
+    {
+        const uint64_t PRIME = 0x100000001B3ull;
+        uint64_t hash = 0xCBF29CE484222325ull;
+
+        std::size_t i = 0;
+        for(; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * PRIME;
+        }
+        for(; i < size; i++)
+            hash = (hash ^ uint8_t(data[i])) * PRIME;
+        return hash;
+    }
+
+    uint64_t hash_file(const std::string& path)
+    {
+        const MappedFile file(path);
+        return hash_bytes(file.begin(), file.size());
+    }
+
+    inline std::size_t aligned(const std::size_t offset)
+    {
+        return (offset + MeshCache::ALIGNMENT - 1) / MeshCache::ALIGNMENT * MeshCache::ALIGNMENT;
+    }
+
+    /**
+     * Copies count elements at offset of the cache into v, returns false
+     * if they would run past its end
+     **/
+    template <typename T>
+    bool read_array(const MappedFile& file, std::size_t& offset, const uint64_t count, std::vector<T>& v)
+    {
+        offset = aligned(offset);
+        const uint64_t bytes = count * sizeof(T);
+        if(count > file.size() || offset + bytes > file.size())
+            return false;
+
+        v.resize(count);
+        std::memcpy(static_cast<void*>(v.data()), file.begin() + offset, bytes);
+        offset += bytes;
+        return true;
+    }
+
+    template <typename T>
+    void write_array(std::ofstream& output, std::size_t& offset, const std::vector<T>& v)
+    {
+        static const char padding[MeshCache::ALIGNMENT] = {};
+        output.write(padding, aligned(offset) - offset);
+        offset = aligned(offset);
+
+        output.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+        offset += v.size() * sizeof(T);
+    }
+}
+
+std::string MeshCache::cache_path(const std::string& source_path)
+{
+    return source_path + ".rtcache";
+}
+
+bool MeshCache::load(const std::string& source_path, TriangleMesh& mesh)
+{
+    const std::string path = cache_path(source_path);
+
+    SourceInfo source;
+    if(!source_info(source_path, source) || !std::filesystem::exists(path))
+        return false;
+
+    bool touched = false;
+    try {
+        const MappedFile file(path);
+
+        MeshCacheHeader header;
+        if(file.size() < sizeof(header))
+            return false;
+        std::memcpy(&header, file.begin(), sizeof(header));
+
+        if(header.magic      != MESH_CACHE_MAGIC   ||
+           header.version    != MESH_CACHE_VERSION ||
+           header.block_size != sizeof(TriangleBlock) ||
+           header.vector_size != sizeof(Vec3) ||
+           header.source_size != source.size)
+            return false;
+
+        // A copied or touched file may still have the same contents
+        if(header.source_mtime != source.mtime)
+        {
+            if(header.source_hash != hash_file(source_path))
+                return false;
+            touched = true;
+        }
+
+        std::size_t offset = sizeof(header);
+        const bool complete = read_array(file, offset, header.num_vertices,         mesh.vertices)         &&
+                              read_array(file, offset, header.num_normals,          mesh.normals)          &&
+                              read_array(file, offset, header.num_texcoords,        mesh.texcoords)        &&
+                              read_array(file, offset, header.num_indices,          mesh.indices)          &&
+                              read_array(file, offset, header.num_normal_indices,   mesh.normal_indices)   &&
+                              read_array(file, offset, header.num_texcoord_indices, mesh.texcoord_indices) &&
+                              read_array(file, offset, header.num_nodes,            mesh.bvh.nodes)        &&
+                              read_array(file, offset, header.num_prim_indices,     mesh.bvh.prim_indices) &&
+                              read_array(file, offset, header.num_blocks,           mesh.blocks);
+        if(!complete)
+        {
+            mesh = TriangleMesh(mesh.material);
+            return false;
+        }
+    }
+    catch (std::runtime_error&) {
+        return false;
+    }
+
+    // Record the new time, once the cache is no longer mapped, so that the
+    // source is not hashed again on every later load. Failing that only
+    // costs the hash next time
+    if(touched)
+    {
+        std::fstream output(path, std::ios::binary | std::ios::in | std::ios::out);
+        output.seekp(offsetof(MeshCacheHeader, source_mtime));
+        output.write(reinterpret_cast<const char*>(&source.mtime), sizeof(source.mtime));
+    }
+    return true;
+}
+
+bool MeshCache::save(const std::string& source_path, const TriangleMesh& mesh)
+{
+    const std::string path      = cache_path(source_path);
+    const std::string temp_path = path + ".tmp";
+
+    SourceInfo source;
+    if(!source_info(source_path, source))
+        return false;
+
+    MeshCacheHeader header = {};
+    header.magic                = MESH_CACHE_MAGIC;
+    header.version              = MESH_CACHE_VERSION;
+    header.block_size           = sizeof(TriangleBlock);
+    header.vector_size          = sizeof(Vec3);
+    header.source_size          = source.size;
+    header.source_mtime         = source.mtime;
+    header.num_vertices         = mesh.vertices.size();
+    header.num_normals          = mesh.normals.size();
+    header.num_texcoords        = mesh.texcoords.size();
+    header.num_indices          = mesh.indices.size();
+    header.num_normal_indices   = mesh.normal_indices.size();
+    header.num_texcoord_indices = mesh.texcoord_indices.size();
+    header.num_nodes            = mesh.bvh.nodes.size();
+    header.num_prim_indices     = mesh.bvh.prim_indices.size();
+    header.num_blocks           = mesh.blocks.size();
+
+    try {
+        header.source_hash = hash_file(source_path);
+    }
+    catch (std::runtime_error&) {
+        return false;
+    }
+
+    {
+        std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+        if(!output)
+            return false;
+
+        std::size_t offset = sizeof(header);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_array(output, offset, mesh.vertices);
+        write_array(output, offset, mesh.normals);
+        write_array(output, offset, mesh.texcoords);
+        write_array(output, offset, mesh.indices);
+        write_array(output, offset, mesh.normal_indices);
+        write_array(output, offset, mesh.texcoord_indices);
+        write_array(output, offset, mesh.bvh.nodes);
+        write_array(output, offset, mesh.bvh.prim_indices);
+        write_array(output, offset, mesh.blocks);
+
+        output.close();
+        if(!output)
+        {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+
+    // rename() does not replace an existing file everywhere
+    if(std::rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        std::remove(path.c_str());
+        if(std::rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef GRAPHICS_MESH_CACHE_H
+#define GRAPHICS_MESH_CACHE_H
+
+#include "TriangleMesh.h"
+
+#include <string>
+#include <cstdint>
+
+#pragma pack(1)
+/**
+ * Followed by the arrays of a built TriangleMesh in the order of their
+ * counts below, each starting on a multiple of ALIGNMENT bytes
+ **/
+struct MeshCacheHeader
+{
+    uint32_t magic;             // 'R', 'T', 'M', 'C'
+    uint32_t version;
+    uint32_t block_size;        // sizeof(TriangleBlock), which varies with the SIMD width
+    uint32_t vector_size;       // sizeof(Vec3), 16 if it is padded for SSE and 12 if not
+
+    // The .OBJ file the mesh was loaded from
+    uint64_t source_size;
+    int64_t  source_mtime;
+    uint64_t source_hash;
+
+    uint64_t num_vertices;
+    uint64_t num_normals;
+    uint64_t num_texcoords;
+    uint64_t num_indices;
+    uint64_t num_normal_indices;
+    uint64_t num_texcoord_indices;
+    uint64_t num_nodes;
+    uint64_t num_prim_indices;
+    uint64_t num_blocks;
+};
+#pragma pack()
+
+/**
+ * Built triangle meshes saved next to the .OBJ file they came from, as
+ * [path].rtcache, so that loading a model again is a copy of each array
+ * out of the mapped cache instead of parsing it and building its BVH.
+ *
+ * A cache is used if the size and modification time of the source match
+ * those it was made from, or failing the latter, if the hash of its
+ * contents does
+ **/
+class MeshCache {
+public:
+    static constexpr uint32_t ALIGNMENT = 64;
+
+    static std::string cache_path(const std::string& source_path);
+
+    /**
+     * Fills mesh, which must be empty, from the cache of source_path and
+     * returns true, or returns false if there is no usable cache
+     **/
+    static bool load(const std::string& source_path, TriangleMesh& mesh);
+
+    /**
+     * Writes the cache of a mesh loaded from source_path and built,
+     * returns false if it could not be written
+     **/
+    static bool save(const std::string& source_path, const TriangleMesh& mesh);
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "MeshInstance.h"
+
+MeshInstance::MeshInstance(const Mesh* mesh, const Transform& object_to_world):
+    mesh(mesh),
+    object_to_world(object_to_world),
+    world_to_object(object_to_world.inverse()),
+    is_identity(object_to_world.is_identity())
+{
+}
+
+bool MeshInstance::hit(const Ray& r, const scalar t_min, const scalar t_max, HitRecord& rec) const
+{
+    if(is_identity)
+        return mesh->bvh.hit(mesh->primitives, r, t_min, t_max, rec);
+
+    // Affine maps preserve the ray parameter, so t_min, t_max and the
+    // resulting rec.t need no conversion between the two spaces
+    const Ray local = world_to_object.ray(r);
+    if(!mesh->bvh.hit(mesh->primitives, local, t_min, t_max, rec))
+        return false;
+
+    hit_to_world(r, local, rec);
+    return true;
+}
+
+void MeshInstance::hit_packet(RayPacket&      packet,
+                              const uint32_t* active,
+                              const uint32_t  num_active,
+                              const scalar    t_min,
+                              HitRecord*      recs) const
+{
+    if(num_active == 0)
+        return;
+
+    auto trace = [&](RayPacket& rays) {
+        mesh->bvh.traverse_packet(rays, t_min, active[0],
+            [&](const BVHNode& leaf, const uint32_t* leaf_active, const uint32_t leaf_num_active) {
+                for(uint32_t i = 0; i < leaf.prim_count; i++)
+                {
+                    const Primitive* prim = mesh->primitives[mesh->bvh.prim_indices[leaf.left_first + i]];
+                    prim->hit_packet(rays, leaf_active, leaf_num_active, t_min, recs);
+                }
+            });
+    };
+
+    if(is_identity)
+    {
+        trace(packet);
+        return;
+    }
+
+    // An affine map keeps the rays to a common origin, and their t. Rays
+    // which are not active are kept from hitting anything
+    RayPacket local;
+    local.reset(world_to_object.point(packet.origin), packet.count);
+    for(uint32_t i = 0; i < packet.count; i++)
+    {
+        local.set_direction(i, world_to_object.vector(packet.direction(i)));
+        local.t_max[i] = -FLT_MAX;
+    }
+    for(uint32_t k = 0; k < num_active; k++)
+        local.t_max[active[k]] = packet.t_max[active[k]];
+    local.prepare();
+    trace(local);
+
+    for(uint32_t k = 0; k < num_active; k++)
+    {
+        const uint32_t i = active[k];
+        if(local.t_max[i] < packet.t_max[i])
+        {
+            hit_to_world(packet.ray(i), local.ray(i), recs[i]);
+            packet.t_max[i] = local.t_max[i];
+        }
+    }
+}
+
+void MeshInstance::hit_to_world(const Ray& r, const Ray& local, HitRecord& rec) const
+{
+    rec.point_at_t = r.point_at_t(rec.t);
+    rec.normal     = normalize(world_to_object.normal_from_inverse(rec.normal));
+    rec.tangent    = object_to_world.vector(rec.tangent);
+    rec.bitangent  = object_to_world.vector(rec.bitangent);
+
+    // Surface area scales with the square of lengths, measured along the ray
+    rec.uv_density *= local.direction().magnitude_squared() / r.direction().magnitude_squared();
+
+    // Lights are only sampled in world space, so a transformed primitive
+    // must not be mistaken for one of them
+    rec.primitive  = this;
+}
+
+bool MeshInstance::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    if(is_identity)
+        return mesh->bvh.occluded(mesh->primitives, r, t_min, t_max);
+    return mesh->bvh.occluded(mesh->primitives, world_to_object.ray(r), t_min, t_max);
+}
+
+BoundsDefinition MeshInstance::get_bounds() const
+{
+    const AABB& local = mesh->bounds;
+    if(is_identity)
+        return BoundsDefinition { local.lower, local.upper };
+
+    // Enclose all eight transformed corners of the object space box
+    AABB world;
+    for(int corner = 0; corner < 8; corner++)
+    {
+        world.grow(object_to_world.point(Vec3({
+            (corner & 1) ? local.upper.x() : local.lower.x(),
+            (corner & 2) ? local.upper.y() : local.lower.y(),
+            (corner & 4) ? local.upper.z() : local.lower.z(),
+        })));
+    }
+    return BoundsDefinition { world.lower, world.upper };
+}
+
+bool MeshInstance::is_unbounded() const
+{
+    const BoundsDefinition bounds = get_bounds();
+    return AABB(bounds.lower_far_corner, bounds.upper_near_corner).is_unbounded();
+}
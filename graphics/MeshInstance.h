@@ -0,0 +1,38 @@
+#ifndef GRAPHICS_MESH_INSTANCE_H
+#define GRAPHICS_MESH_INSTANCE_H
+
+#include "Primitive.h"
+#include "Mesh.h"
+#include "../math/Transform.h"
+
+/**
+ * Places a mesh in the scene through an object-to-world transform.
+ * Several instances may refer to the same mesh, which is not owned
+ * by the instance. Rays are brought into object space and traced
+ * against the mesh's own BVH, so instances double as the leaves of
+ * the scene's top-level BVH
+ **/
+class MeshInstance : public Primitive {
+public:
+    MeshInstance(const Mesh* mesh, const Transform& object_to_world = Transform());
+
+    virtual bool hit(const Ray& r, const float t_min, const float t_max, HitRecord& rec) const;
+    virtual bool occluded(const Ray& r, const float t_min, const float t_max) const;
+    virtual void hit_packet(RayPacket& packet, const uint32_t* active, const uint32_t num_active,
+                            const float t_min, HitRecord* recs) const;
+    BoundsDefinition get_bounds() const;
+
+    // Planes and the like cannot be placed in a BVH
+    bool is_unbounded() const;
+
+    const Mesh* mesh;
+    Transform   object_to_world;
+    Transform   world_to_object;
+private:
+    // Brings a hit found along local, r in object space, into world space
+    void hit_to_world(const Ray& r, const Ray& local, HitRecord& rec) const;
+
+    bool is_identity;
+};
+
+#endif
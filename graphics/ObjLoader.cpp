@@ -0,0 +1,283 @@
+#include "ObjLoader.h"
+#include "../util/MappedFile.h"
+#include "../util/ParallelFor.h"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    // Files smaller than this are not worth splitting
+    constexpr std::size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    inline bool is_blank(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* skip_blanks(const char* p, const char* end)
+    {
+        while(p < end && is_blank(*p))
+            p++;
+        return p;
+    }
+
+    inline const char* line_end(const char* p, const char* end)
+    {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        return newline != nullptr ? newline : end;
+    }
+
+    [[noreturn]] void throw_parse_error(const uint32_t line, const char* what)
+    {
+        throw std::runtime_error("[Error] Invalid obj file, line " + std::to_string(line) + ": " + what);
+    }
+
+    // from_chars takes neither leading blanks nor a '+' sign
+    inline const char* parse_scalar(const char* p, const char* end, scalar& value, const uint32_t line)
+    {
+        p = skip_blanks(p, end);
+        if(p < end && *p == '+')
+            p++;
+        const std::from_chars_result result = std::from_chars(p, end, value);
+        if(result.ec != std::errc())
+            throw_parse_error(line, "expected a number");
+        return result.ptr;
+    }
+
+    template <std::size_t N>
+    inline const char* parse_vector(const char* p, const char* end, Vector<N>& v, const uint32_t line)
+    {
+        for(std::size_t i = 0; i < N; i++)
+            p = parse_scalar(p, end, v[i], line);
+        return p;
+    }
+
+    /**
+     * Turns a 1-based index as written into a 0-based one, which if it was
+     * negative is relative to the count elements parsed so far
+     **/
+    inline const char* parse_index(const char* p, const char* end, const std::size_t count, 
+                                   uint32_t& index, bool& relative, const uint32_t line)
+    {
+        int32_t value = 0;
+        const std::from_chars_result result = std::from_chars(p, end, value);
+        if(result.ec != std::errc() || value == 0)
+            throw_parse_error(line, "expected a face index");
+
+        relative = value < 0;
+        index    = relative ? uint32_t(count) + uint32_t(value) : uint32_t(value - 1);
+        return result.ptr;
+    }
+
+    /**
+     * Splits [begin, end) into about count runs of whole lines, returning
+     * count + 1 boundaries
+     **/
+    std::vector<const char*> split_lines(const char* begin, const char* end, const uint32_t count)
+    {
+        std::vector<const char*> bounds = { begin };
+        const std::size_t size = end - begin;
+        for(uint32_t i = 1; i < count; i++)
+        {
+            const char* split = std::max(bounds.back(), begin + size * i / count);
+            split = line_end(split, end);
+            if(split < end)
+                split++;
+            bounds.push_back(split);
+        }
+        bounds.push_back(end);
+        return bounds;
+    }
+
+    /**
+     * Copies one kind of index of a chunk into place, first adding base to
+     * its relative corners, then offset to all of them so that they refer
+     * to elements in the mesh, of which there are size
+     **/
+    void place_indices(std::vector<uint32_t>&       indices,
+                       const std::vector<uint32_t>& relative_corners,
+                       uint32_t*                    output,
+                       const uint32_t               base,
+                       const uint32_t               offset,
+                       const uint64_t               size)
+    {
+        for(const uint32_t corner : relative_corners)
+            indices[corner] += base;
+
+        for(std::size_t i = 0; i < indices.size(); i++)
+        {
+            const uint64_t index = uint64_t(offset) + indices[i];
+            if(index >= size)
+                throw std::runtime_error("[Error] Invalid obj file, a face refers to a missing vertex");
+            output[i] = uint32_t(index);
+        }
+    }
+}
+
+void parse_obj(const char* begin, const char* end, ObjData& data, const uint32_t first_line)
+{
+    // Corners of the face being read, which is then fanned out from its first
+    struct Corner
+    {
+        uint32_t position, texcoord, normal;
+        bool     relative_position, relative_texcoord, relative_normal;
+        bool     has_texcoord, has_normal;
+    };
+    std::vector<Corner> face;
+
+    const char* p = begin;
+    while(p < end)
+    {
+        const char* eol = line_end(p, end);
+        const uint32_t line = first_line + data.line_count++;
+
+        p = skip_blanks(p, eol);
+        if(eol - p >= 2 && p[0] == 'v' && is_blank(p[1]))
+        {
+            Vec3 position;
+            parse_vector(p + 2, eol, position, line);
+            data.positions.push_back(position);
+        }
+        else if(eol - p >= 3 && p[0] == 'v' && p[1] == 'n' && is_blank(p[2]))
+        {
+            Vec3 normal;
+            parse_vector(p + 3, eol, normal, line);
+            data.normals.push_back(normalize(normal));
+        }
+        else if(eol - p >= 3 && p[0] == 'v' && p[1] == 't' && is_blank(p[2]))
+        {
+            // A third (w) coordinate, if any, is ignored
+            Vec2 texcoord;
+            parse_vector(p + 3, eol, texcoord, line);
+            data.texcoords.push_back(texcoord);
+        }
+        else if(eol - p >= 2 && p[0] == 'f' && is_blank(p[1]))
+        {
+            face.clear();
+
+            p = skip_blanks(p + 2, eol);
+            while(p < eol)
+            {
+                Corner corner = {};
+                p = parse_index(p, eol, data.positions.size(), corner.position, corner.relative_position, line);
+                if(p < eol && *p == '/')
+                {
+                    p++;
+                    corner.has_texcoord = p < eol && *p != '/';
+                    if(corner.has_texcoord)
+                        p = parse_index(p, eol, data.texcoords.size(), corner.texcoord, corner.relative_texcoord, line);
+
+                    corner.has_normal = p < eol && *p == '/';
+                    if(corner.has_normal)
+                        p = parse_index(p + 1, eol, data.normals.size(), corner.normal, corner.relative_normal, line);
+                }
+                if(p < eol && !is_blank(*p))
+                    throw_parse_error(line, "unexpected character in a face");
+
+                face.push_back(corner);
+                p = skip_blanks(p, eol);
+            }
+
+            if(face.size() < 3)
+                throw_parse_error(line, "a face needs at least 3 vertices");
+
+            for(std::size_t i = 1; i + 1 < face.size(); i++)
+            {
+                const Corner* triangle[3] = { &face[0], &face[i], &face[i + 1] };
+                for(const Corner* corner : triangle)
+                {
+                    const uint32_t index = data.position_indices.size();
+                    if(corner->relative_position) data.relative_positions.push_back(index);
+                    if(corner->relative_texcoord) data.relative_texcoords.push_back(index);
+                    if(corner->relative_normal)   data.relative_normals  .push_back(index);
+                    data.missing_texcoords += corner->has_texcoord ? 0 : 1;
+                    data.missing_normals   += corner->has_normal   ? 0 : 1;
+
+                    data.position_indices.push_back(corner->position);
+                    data.texcoord_indices.push_back(corner->texcoord);
+                    data.normal_indices  .push_back(corner->normal);
+                }
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+void load_obj(const std::string& path, TriangleMesh& mesh)
+{
+    const MappedFile file(path);
+
+    // More chunks than threads, as their cost varies with what is in them
+    const uint32_t num_chunks = uint32_t(std::min<std::size_t>(4 * hardware_threads(), file.size() / MIN_CHUNK_SIZE + 1));
+    const std::vector<const char*> bounds = split_lines(file.begin(), file.end(), num_chunks);
+
+    std::vector<ObjData> chunks(num_chunks);
+    try {
+        parallel_for(num_chunks, [&](uint32_t i) {
+            parse_obj(bounds[i], bounds[i + 1], chunks[i]);
+        });
+    }
+    catch (std::runtime_error&) {
+        // Only the whole file knows the line numbers, so parse it all again
+        // to report the first error where it actually is
+        ObjData whole;
+        parse_obj(file.begin(), file.end(), whole);
+        throw;
+    }
+
+    // Where each chunk starts in the mesh, and in the file, per kind of element
+    struct ChunkOffsets
+    {
+        std::size_t position, texcoord, normal, corner;
+    };
+    std::vector<ChunkOffsets> offsets(num_chunks + 1);
+    offsets[0] = { mesh.vertices.size(), mesh.texcoords.size(), mesh.normals.size(), mesh.indices.size() };
+
+    uint64_t missing_texcoords = mesh.indices.size() - mesh.texcoord_indices.size();
+    uint64_t missing_normals   = mesh.indices.size() - mesh.normal_indices.size();
+    for(uint32_t i = 0; i < num_chunks; i++)
+    {
+        offsets[i + 1].position = offsets[i].position + chunks[i].positions.size();
+        offsets[i + 1].texcoord = offsets[i].texcoord + chunks[i].texcoords.size();
+        offsets[i + 1].normal   = offsets[i].normal   + chunks[i].normals.size();
+        offsets[i + 1].corner   = offsets[i].corner   + chunks[i].position_indices.size();
+        missing_texcoords += chunks[i].missing_texcoords;
+        missing_normals   += chunks[i].missing_normals;
+    }
+    const ChunkOffsets& first = offsets.front();
+    const ChunkOffsets& total = offsets.back();
+
+    // Per corner attributes are all or nothing for the whole mesh
+    const bool all_texcoords = missing_texcoords == 0;
+    const bool all_normals   = missing_normals   == 0;
+
+    mesh.vertices .resize(total.position);
+    mesh.texcoords.resize(total.texcoord);
+    mesh.normals  .resize(total.normal);
+    mesh.indices  .resize(total.corner);
+    mesh.texcoord_indices.resize(all_texcoords ? total.corner : 0);
+    mesh.normal_indices  .resize(all_normals   ? total.corner : 0);
+
+    parallel_for(num_chunks, [&](uint32_t i) {
+        ObjData&            chunk  = chunks[i];
+        const ChunkOffsets& offset = offsets[i];
+
+        std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.vertices.begin()  + offset.position);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), mesh.texcoords.begin() + offset.texcoord);
+        std::copy(chunk.normals.begin(),   chunk.normals.end(),   mesh.normals.begin()   + offset.normal);
+
+        place_indices(chunk.position_indices, chunk.relative_positions, mesh.indices.data() + offset.corner,
+                      offset.position - first.position, first.position, total.position);
+        if(all_texcoords)
+            place_indices(chunk.texcoord_indices, chunk.relative_texcoords, mesh.texcoord_indices.data() + offset.corner,
+                          offset.texcoord - first.texcoord, first.texcoord, total.texcoord);
+        if(all_normals)
+            place_indices(chunk.normal_indices, chunk.relative_normals, mesh.normal_indices.data() + offset.corner,
+                          offset.normal - first.normal, first.normal, total.normal);
+
+        // Release the chunk as soon as it has been placed
+        chunk = ObjData();
+    });
+}
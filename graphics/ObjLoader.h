@@ -0,0 +1,65 @@
+#ifndef GRAPHICS_OBJ_LOADER_H
+#define GRAPHICS_OBJ_LOADER_H
+
+#include "TriangleMesh.h"
+#include "../math/Vector.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/**
+ * Geometry parsed from a Wavefront .OBJ file, or from a run of whole
+ * lines of one. Faces are fan triangulated into 3 corners per triangle,
+ * each corner holding a 0-based position, texture coordinate and normal
+ * index.
+ *
+ * A negative index in the file counts back from the elements read so
+ * far, so those are stored relative to the start of this data instead,
+ * and the corners listed in relative_* must have the number of elements
+ * before it added, which wraps them around to the right index if they
+ * refer to an element before it
+ **/
+struct ObjData
+{
+    std::vector<Vec3> positions;
+    std::vector<Vec2> texcoords;
+    std::vector<Vec3> normals;
+
+    std::vector<uint32_t> position_indices;   // 3 per triangle
+    std::vector<uint32_t> texcoord_indices;
+    std::vector<uint32_t> normal_indices;
+
+    std::vector<uint32_t> relative_positions;  // Corners, in increasing order
+    std::vector<uint32_t> relative_texcoords;
+    std::vector<uint32_t> relative_normals;
+
+    // Corners which do not specify one, their index is then 0
+    uint64_t missing_texcoords = 0;
+    uint64_t missing_normals   = 0;
+
+    uint32_t line_count = 0;   // Lines consumed
+};
+
+/**
+ * Parses the v, vt, vn and f statements between begin and end, all other
+ * statements being ignored. Faces may use any of the v, v/vt, v//vn and
+ * v/vt/vn forms and have any number of corners. Throws on malformed
+ * numbers, zero indices and faces with fewer than 3 corners, with the
+ * line number counted from first_line
+ **/
+void parse_obj(const char* begin, const char* end, ObjData& data, const uint32_t first_line = 1);
+
+/**
+ * Memory maps and parses the .OBJ file at path, appending its triangles
+ * to mesh. Large files are split into chunks of whole lines which are
+ * parsed in parallel, and then joined with a prefix sum over the number
+ * of elements in each.
+ *
+ * Texture coordinates and vertex normals are only kept if every face
+ * specifies them. Throws if the file cannot be read, or if a face refers
+ * to an element that does not exist. Does not build the mesh
+ **/
+void load_obj(const std::string& path, TriangleMesh& mesh);
+
+#endif
@@ -16,6 +16,7 @@ bool Plane::hit(const Ray& r,
             rec.point_at_t   = r.point_at_t(rec.t);
             rec.normal       = normal;
             rec.material_ptr = material;
+            rec.primitive    = this;
             return true;
         }
         return false;
@@ -23,6 +24,16 @@ bool Plane::hit(const Ray& r,
     return false;
 }
 
+bool Plane::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    const scalar denom = -dot(normal, r.direction());
+    if(denom <= 1e-6)
+        return false;
+
+    const scalar t = dot(normal, r.origin() - origin) / denom;
+    return t_min < t && t < t_max;
+}
+
 BoundsDefinition Plane::get_bounds() const
 {
     return BoundsDefinition {
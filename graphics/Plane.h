@@ -3,7 +3,7 @@
 
 #include "Primitive.h"
 
-class Plane : public Primitive {
+class Plane final : public Primitive {
 public:
     Plane(const Vec3& origin, 
           const Vec3& normal, 
@@ -13,6 +13,7 @@ public:
     }
 
     virtual bool hit(const Ray& r, const float t_min, const float t_max, HitRecord& rec) const;
+    virtual bool occluded(const Ray& r, const float t_min, const float t_max) const;
     BoundsDefinition get_bounds() const;
 
     Vec3 normal;
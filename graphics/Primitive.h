@@ -2,6 +2,7 @@
 #define GEOM_H
 
 #include "Material.h"
+#include "RayPacket.h"
 #include "../math/Vector.h"
 #include "../math/Ray.h"
 
@@ -21,8 +22,51 @@ public:
                      const float t_min, 
                      const float t_max, 
                      HitRecord&  rec) const = 0;
+    /**
+     * Any-hit query, true if anything at all lies within [t_min, t_max].
+     * Unlike hit() it may stop at the first intersection found and need
+     * not compute normals, UVs or tangents, so override it where cheaper
+     **/
+    virtual bool occluded(const Ray&  r,
+                          const float t_min,
+                          const float t_max) const
+    {
+        HitRecord rec = {};
+        return hit(r, t_min, t_max, rec);
+    }
+    /**
+     * Closest-hit query for the num_active rays of a packet listed in
+     * active, in increasing order, each against its own packet.t_max.
+     * Fills in recs[i] and lowers packet.t_max[i] for every ray i it finds
+     * a nearer hit for. By default the rays are traced one by one,
+     * aggregates override it to traverse their hierarchies with the packet
+     **/
+    virtual void hit_packet(RayPacket&      packet,
+                            const uint32_t* active,
+                            const uint32_t  num_active,
+                            const float     t_min,
+                            HitRecord*      recs) const
+    {
+        for(uint32_t k = 0; k < num_active; k++)
+        {
+            const uint32_t i = active[k];
+            if(hit(packet.ray(i), t_min, packet.t_max[i], recs[i]))
+                packet.t_max[i] = recs[i].t;
+        }
+    }
     virtual ~Primitive() {}
     virtual BoundsDefinition get_bounds() const = 0;
+
+    /**
+     * Area light interface, only implemented by primitives which can be
+     * sampled. sample_direction() picks a unit direction wi from ref_point
+     * towards the surface and returns its pdf with respect to solid angle,
+     * which direction_pdf() also returns for a point found by tracing.
+     * A pdf of 0 means no sample could be taken
+     **/
+    virtual bool   emits_light() const { return false; }
+    virtual scalar sample_direction(const Vec3&, Vec3&) const { return 0.0f; }
+    virtual scalar direction_pdf(const Vec3&, const Vec3&) const { return 0.0f; }
 };
 
 #endif
@@ -0,0 +1,192 @@
+#include "PrimitiveGroup.h"
+
+#include <algorithm>
+
+template <typename T>
+void PrimitiveGroup::add_refs(const std::vector<T>& prims, PrimitiveType type,
+                              std::vector<PrimitiveRef>& all_refs, std::vector<AABB>& bounds)
+{
+    for(uint32_t i = 0; i < prims.size(); i++)
+    {
+        const BoundsDefinition b = prims[i].T::get_bounds();
+        bounds.push_back(AABB(b.lower_far_corner, b.upper_near_corner));
+        all_refs.push_back(PrimitiveRef{ type, i });
+    }
+}
+
+void PrimitiveGroup::build()
+{
+    std::vector<PrimitiveRef> unordered_refs;
+    std::vector<AABB> bounds;
+
+    add_refs(spheres,    PrimitiveType::SPHERE,      unordered_refs, bounds);
+    add_refs(triangles,  PrimitiveType::TRIANGLE,    unordered_refs, bounds);
+    add_refs(rectangles, PrimitiveType::RECTANGLE3D, unordered_refs, bounds);
+
+    bvh.build(bounds);
+
+    // Lay the references out in leaf order, and within each leaf group 
+    // them by type so that consecutive tests go through the same code
+    refs.resize(unordered_refs.size());
+    for(std::size_t i = 0; i < refs.size(); i++)
+        refs[i] = unordered_refs[bvh.prim_indices[i]];
+
+    for(const BVHNode& node : bvh.nodes)
+    {
+        if(!node.is_leaf())
+            continue;
+        std::stable_sort(refs.begin() + node.left_first, 
+                         refs.begin() + node.left_first + node.prim_count,
+                         [](const PrimitiveRef& a, const PrimitiveRef& b) { return a.type < b.type; });
+    }
+}
+
+std::size_t PrimitiveGroup::size() const
+{
+    return spheres.size() + triangles.size() + rectangles.size() + planes.size();
+}
+
+void PrimitiveGroup::collect_lights(std::vector<const Primitive*>& lights) const
+{
+    for(const Sphere& sphere : spheres)
+    {
+        if(sphere.emits_light())
+            lights.push_back(&sphere);
+    }
+    for(const Triangle& triangle : triangles)
+    {
+        if(triangle.emits_light())
+            lights.push_back(&triangle);
+    }
+    for(const Rectangle3D& rectangle : rectangles)
+    {
+        if(rectangle.emits_light())
+            lights.push_back(&rectangle);
+    }
+}
+
+inline bool PrimitiveGroup::hit_ref(const PrimitiveRef& ref, const Ray& r, const scalar t_min, const scalar t_max, HitRecord& rec) const
+{
+    switch(ref.type)
+    {
+        case PrimitiveType::SPHERE:
+            return hit_primitive(spheres[ref.index], r, t_min, t_max, rec);
+        case PrimitiveType::TRIANGLE:
+            return hit_primitive(triangles[ref.index], r, t_min, t_max, rec);
+        case PrimitiveType::RECTANGLE3D:
+            return hit_primitive(rectangles[ref.index], r, t_min, t_max, rec);
+    }
+    return false;
+}
+
+inline bool PrimitiveGroup::occluded_ref(const PrimitiveRef& ref, const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    switch(ref.type)
+    {
+        case PrimitiveType::SPHERE:
+            return primitive_occluded(spheres[ref.index], r, t_min, t_max);
+        case PrimitiveType::TRIANGLE:
+            return primitive_occluded(triangles[ref.index], r, t_min, t_max);
+        case PrimitiveType::RECTANGLE3D:
+            return primitive_occluded(rectangles[ref.index], r, t_min, t_max);
+    }
+    return false;
+}
+
+bool PrimitiveGroup::hit(const Ray& r, const scalar t_min, const scalar t_max, HitRecord& rec) const
+{
+    HitRecord temp_rec = {};
+    scalar closest     = t_max;
+
+    // Primitives only write to temp_rec when they are nearer than closest
+    bool hit_anything = bvh.traverse(r, t_min, closest, [&](const BVHNode& leaf, scalar& nearest) {
+        bool hit_leaf = false;
+        for(uint32_t i = 0; i < leaf.prim_count; i++)
+        {
+            if(hit_ref(refs[leaf.left_first + i], r, t_min, nearest, temp_rec))
+            {
+                nearest  = temp_rec.t;
+                hit_leaf = true;
+            }
+        }
+        return hit_leaf;
+    });
+
+    for(const Plane& plane : planes)
+    {
+        if(hit_primitive(plane, r, t_min, closest, temp_rec))
+        {
+            closest      = temp_rec.t;
+            hit_anything = true;
+        }
+    }
+
+    if(hit_anything)
+        rec = temp_rec;
+    return hit_anything;
+}
+
+void PrimitiveGroup::hit_packet(RayPacket&      packet,
+                                const uint32_t* active,
+                                const uint32_t  num_active,
+                                const scalar    t_min,
+                                HitRecord*      recs) const
+{
+    if(num_active == 0)
+        return;
+
+    // Leaves test their members against the rays which reach them, one ray at a time
+    bvh.traverse_packet(packet, t_min, active[0],
+        [&](const BVHNode& leaf, const uint32_t* leaf_active, const uint32_t leaf_num_active) {
+            for(uint32_t k = 0; k < leaf_num_active; k++)
+            {
+                const uint32_t j = leaf_active[k];
+                const Ray      r = packet.ray(j);
+                for(uint32_t i = 0; i < leaf.prim_count; i++)
+                {
+                    if(hit_ref(refs[leaf.left_first + i], r, t_min, packet.t_max[j], recs[j]))
+                        packet.t_max[j] = recs[j].t;
+                }
+            }
+        });
+
+    for(uint32_t k = 0; k < num_active && !planes.empty(); k++)
+    {
+        const uint32_t j = active[k];
+        const Ray      r = packet.ray(j);
+        for(const Plane& plane : planes)
+        {
+            if(hit_primitive(plane, r, t_min, packet.t_max[j], recs[j]))
+                packet.t_max[j] = recs[j].t;
+        }
+    }
+}
+
+bool PrimitiveGroup::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    for(const Plane& plane : planes)
+    {
+        if(primitive_occluded(plane, r, t_min, t_max))
+            return true;
+    }
+
+    return bvh.traverse_any(r, t_min, t_max, [&](const BVHNode& leaf) {
+        for(uint32_t i = 0; i < leaf.prim_count; i++)
+        {
+            if(occluded_ref(refs[leaf.left_first + i], r, t_min, t_max))
+                return true;
+        }
+        return false;
+    });
+}
+
+BoundsDefinition PrimitiveGroup::get_bounds() const
+{
+    AABB bounds = bvh.bounds();
+    for(const Plane& plane : planes)
+    {
+        const BoundsDefinition b = plane.Plane::get_bounds();
+        bounds.grow(AABB(b.lower_far_corner, b.upper_near_corner));
+    }
+    return BoundsDefinition { bounds.lower, bounds.upper };
+}
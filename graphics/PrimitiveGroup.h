@@ -0,0 +1,92 @@
+#ifndef GRAPHICS_PRIMITIVE_GROUP_H
+#define GRAPHICS_PRIMITIVE_GROUP_H
+
+#include "Primitive.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Rectangle3D.h"
+#include "Plane.h"
+#include "BVH.h"
+
+#include <vector>
+#include <cstdint>
+
+enum class PrimitiveType : uint32_t {
+    SPHERE,
+    TRIANGLE,
+    RECTANGLE3D,
+};
+
+// Tagged reference into one of the per-type arrays of a PrimitiveGroup
+struct PrimitiveRef
+{
+    PrimitiveType type;
+    uint32_t      index;
+};
+
+/**
+ * Since T is known at compile time (and final), this calls T::hit
+ * directly instead of going through the vtable
+ **/
+template <typename T>
+inline bool hit_primitive(const T& prim, const Ray& r, const scalar t_min, const scalar t_max, HitRecord& rec)
+{
+    return prim.T::hit(r, t_min, t_max, rec);
+}
+
+template <typename T>
+inline bool primitive_occluded(const T& prim, const Ray& r, const scalar t_min, const scalar t_max)
+{
+    return prim.T::occluded(r, t_min, t_max);
+}
+
+/**
+ * Closed set of the built-in primitive types, kept in one homogeneous
+ * array per type rather than as individually allocated Primitive*'s.
+ * A single BVH spans all of them and its leaves dispatch on the type
+ * tag. Planes are unbounded, so they are tested one by one instead.
+ *
+ * The group itself is still a Primitive so that it can be placed in a
+ * Mesh like any other, user-defined primitives keep using the virtual
+ * interface
+ **/
+class PrimitiveGroup : public Primitive {
+public:
+    inline void add(const Sphere&      s) { spheres.push_back(s);    }
+    inline void add(const Triangle&    t) { triangles.push_back(t);  }
+    inline void add(const Rectangle3D& r) { rectangles.push_back(r); }
+    inline void add(const Plane&       p) { planes.push_back(p);     }
+
+    // Must be called once all of the primitives have been added
+    void build();
+
+    inline bool empty() const { return size() == 0; }
+    std::size_t size() const;
+
+    // Appends the members whose material emits light, planes excluded
+    void collect_lights(std::vector<const Primitive*>& lights) const;
+
+    virtual bool hit(const Ray& r, const float t_min, const float t_max, HitRecord& rec) const;
+    virtual bool occluded(const Ray& r, const float t_min, const float t_max) const;
+    virtual void hit_packet(RayPacket& packet, const uint32_t* active, const uint32_t num_active,
+                            const float t_min, HitRecord* recs) const;
+    BoundsDefinition get_bounds() const;
+
+    std::vector<Sphere>      spheres;
+    std::vector<Triangle>    triangles;
+    std::vector<Rectangle3D> rectangles;
+    std::vector<Plane>       planes;
+private:
+    template <typename T>
+    void add_refs(const std::vector<T>& prims, PrimitiveType type,
+                  std::vector<PrimitiveRef>& all_refs, std::vector<AABB>& bounds);
+
+    bool hit_ref     (const PrimitiveRef& ref, const Ray& r, const scalar t_min, const scalar t_max, HitRecord& rec) const;
+    bool occluded_ref(const PrimitiveRef& ref, const Ray& r, const scalar t_min, const scalar t_max) const;
+
+    // In leaf order, so that leaves refer to refs directly
+    std::vector<PrimitiveRef> refs;
+    BVH bvh;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef GRAPHICS_RAY_PACKET_H
+#define GRAPHICS_RAY_PACKET_H
+
+#include "../math/Vector.h"
+#include "../math/Ray.h"
+#include "../math/AABB.h"
+
+#include <cfloat>
+#include <cstdint>
+#include <algorithm>
+
+/**
+ * Up to MAX_SIZE rays leaving one origin, such as the camera rays of a
+ * block of pixels, traced through the hierarchies together. Components
+ * are kept one array per axis, so that a box is tested against a group of
+ * LANES rays in a single loop the compiler turns into vector instructions.
+ *
+ * t_max holds the nearest hit of each ray so far. Rays past count are
+ * padding and never hit anything
+ **/
+struct RayPacket
+{
+    static constexpr uint32_t MAX_SIZE = 256;   // 16 x 16 pixels
+    static constexpr uint32_t LANES    = 8;
+
+    /**
+     * Starts a packet of num_rays rays from origin, whose directions
+     * are then given through set_direction() before calling prepare()
+     **/
+    inline void reset(const Vec3& ray_origin, const uint32_t num_rays)
+    {
+        origin = ray_origin;
+        count  = std::min(num_rays, MAX_SIZE);
+    }
+
+    inline void set_direction(const uint32_t i, const Vec3& direction)
+    {
+        dir_x[i] = direction.x();
+        dir_y[i] = direction.y();
+        dir_z[i] = direction.z();
+        t_max[i] = FLT_MAX;
+    }
+
+    /**
+     * Computes the reciprocal directions, pads the last group of lanes
+     * and, if all of the directions agree in sign along every axis, the
+     * range of their reciprocals for culling with may_hit()
+     **/
+    void prepare()
+    {
+        coherent = count > 0;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            float* dir = axis == 0 ? dir_x : (axis == 1 ? dir_y : dir_z);
+            float* inv = axis == 0 ? inv_x : (axis == 1 ? inv_y : inv_z);
+
+            inv_lo[axis] =  FLT_MAX;
+            inv_hi[axis] = -FLT_MAX;
+            for(uint32_t i = 0; i < count; i++)
+            {
+                inv[i] = 1.0f / dir[i];
+                inv_lo[axis] = std::min(inv_lo[axis], inv[i]);
+                inv_hi[axis] = std::max(inv_hi[axis], inv[i]);
+            }
+            if(!(inv_lo[axis] > 0 || inv_hi[axis] < 0) || !(std::fabs(inv_lo[axis]) < FLT_MAX) ||
+               !(std::fabs(inv_hi[axis]) < FLT_MAX))
+                coherent = false;
+
+            for(uint32_t i = count; i < padded_count(); i++)
+            {
+                dir[i] = 1.0f;
+                inv[i] = 1.0f;
+            }
+        }
+        for(uint32_t i = count; i < padded_count(); i++)
+            t_max[i] = -FLT_MAX;
+    }
+
+    inline uint32_t padded_count() const { return (count + LANES - 1) / LANES * LANES; }
+
+    inline Vec3 direction(const uint32_t i) const { return Vec3({ dir_x[i], dir_y[i], dir_z[i] }); }
+    inline Ray  ray      (const uint32_t i) const { return Ray(origin, direction(i)); }
+
+    /**
+     * Interval test of the whole packet against a box (Wald et al.), false
+     * only if no ray can enter it beyond t_min, without looking at the rays
+     * one by one. Always true for packets which are not coherent
+     **/
+    inline bool may_hit(const AABB& box, const scalar t_min) const
+    {
+        if(!coherent)
+            return true;
+
+        scalar t_enter = t_min;
+        scalar t_exit  = FLT_MAX;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            // The slab planes a ray enters and leaves by depend on its sign only
+            const bool   positive = inv_lo[axis] > 0;
+            const scalar near_d   = (positive ? box.lower[axis] : box.upper[axis]) - origin[axis];
+            const scalar far_d    = (positive ? box.upper[axis] : box.lower[axis]) - origin[axis];
+            t_enter = std::max(t_enter, std::min(near_d * inv_lo[axis], near_d * inv_hi[axis]));
+            t_exit  = std::min(t_exit,  std::max(far_d  * inv_lo[axis], far_d  * inv_hi[axis]));
+        }
+        return t_enter <= t_exit;
+    }
+
+    /**
+     * The first ray from first on which enters the box between t_min and
+     * its nearest hit so far, or count if there is none. Rays are tested a
+     * group of LANES at a time
+     **/
+    inline uint32_t first_hit(const AABB& box, const scalar t_min, const uint32_t first) const
+    {
+        for(uint32_t group = first - first % LANES; group < count; group += LANES)
+        {
+            int32_t hits[LANES];
+            hit_group(box, t_min, group, hits);
+            for(uint32_t lane = group < first ? first - group : 0; lane < LANES; lane++)
+            {
+                if(hits[lane])
+                    return group + lane;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Lists in active the rays from first on which enter the box, as
+     * first_hit() would find them, and returns how many there are
+     **/
+    inline uint32_t active_rays(const AABB& box, const scalar t_min, const uint32_t first, uint32_t* active) const
+    {
+        uint32_t num_active = 0;
+        for(uint32_t group = first - first % LANES; group < count; group += LANES)
+        {
+            int32_t hits[LANES];
+            hit_group(box, t_min, group, hits);
+            for(uint32_t lane = group < first ? first - group : 0; lane < LANES; lane++)
+            {
+                active[num_active] = group + lane;
+                num_active += hits[lane] ? 1 : 0;
+            }
+        }
+        return num_active;
+    }
+
+    /**
+     * Slab test of the rays group to group + LANES - 1, branch free as in
+     * AABB::intersect() so that it vectorizes. Padding rays always miss
+     **/
+    inline void hit_group(const AABB& box, const scalar t_min, const uint32_t group, int32_t hits[LANES]) const
+    {
+        const float lo_x = box.lower.x() - origin.x(), hi_x = box.upper.x() - origin.x();
+        const float lo_y = box.lower.y() - origin.y(), hi_y = box.upper.y() - origin.y();
+        const float lo_z = box.lower.z() - origin.z(), hi_z = box.upper.z() - origin.z();
+
+        for(uint32_t lane = 0; lane < LANES; lane++)
+        {
+            const uint32_t i = group + lane;
+            const float ax = lo_x * inv_x[i], bx = hi_x * inv_x[i];
+            const float ay = lo_y * inv_y[i], by = hi_y * inv_y[i];
+            const float az = lo_z * inv_z[i], bz = hi_z * inv_z[i];
+            const float t0 = std::max(std::max(std::max(t_min,    std::min(ax, bx)), std::min(ay, by)), std::min(az, bz));
+            const float t1 = std::min(std::min(std::min(t_max[i], std::max(ax, bx)), std::max(ay, by)), std::max(az, bz));
+            hits[lane] = t0 <= t1;
+        }
+    }
+
+    Vec3     origin;
+    uint32_t count    = 0;
+    bool     coherent = false;
+
+    scalar inv_lo[3];
+    scalar inv_hi[3];
+
+    alignas(32) float dir_x[MAX_SIZE];
+    alignas(32) float dir_y[MAX_SIZE];
+    alignas(32) float dir_z[MAX_SIZE];
+    alignas(32) float inv_x[MAX_SIZE];
+    alignas(32) float inv_y[MAX_SIZE];
+    alignas(32) float inv_z[MAX_SIZE];
+    alignas(32) float t_max[MAX_SIZE];
+};
+
+#endif
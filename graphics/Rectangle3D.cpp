@@ -36,10 +36,59 @@ bool Rectangle3D::hit(const Ray& r, const scalar t_min, const scalar t_max, HitR
     rec.point_at_t   = r.point_at_t(rec.t);
     rec.normal       = normalize(normal);
     rec.material_ptr = material;
+    rec.primitive    = this;
     return true;
 }
 
 
+bool Rectangle3D::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    // Same tests as hit(), without the normal
+    const Vec3 normal  = cross(B - A, D - A);
+    const scalar denom = -dot(normal, r.direction());
+
+    if(fabs(denom) < 1e-6)
+        return false;
+
+    const scalar t = dot(normal, r.origin() - A) / denom;
+    if(t_min > t || t > t_max)
+        return false;
+
+    const Vec3 Q = r.point_at_t(t);
+    return dot(cross((B - A), (Q - A)), normal) >= 0 &&
+           dot(cross((C - B), (Q - B)), normal) >= 0 &&
+           dot(cross((D - C), (Q - C)), normal) >= 0 &&
+           dot(cross((A - D), (Q - D)), normal) >= 0;
+}
+
+scalar Rectangle3D::sample_direction(const Vec3& ref_point, Vec3& wi) const
+{
+    // Uniform over the area, treating the rectangle as the parallelogram
+    // spanned by AB and AD
+    const Vec2 u     = random_2d();
+    const Vec3 point = A + u.x() * (B - A) + u.y() * (D - A);
+
+    wi = point - ref_point;
+    if(wi.magnitude_squared() == 0)
+        return 0.0f;
+    wi.normalize();
+    return direction_pdf(ref_point, point);
+}
+
+scalar Rectangle3D::direction_pdf(const Vec3& ref_point, const Vec3& point) const
+{
+    const Vec3   normal   = cross(B - A, D - A);
+    const scalar area     = normal.magnitude();
+    const Vec3   to_point = point - ref_point;
+    const scalar dist_sq  = to_point.magnitude_squared();
+
+    // |cos| * area, without normalizing either vector first
+    const scalar projected = std::fabs(dot(normal, to_point)) / std::sqrt(dist_sq);
+    if(area == 0 || projected < 1e-6 * area)
+        return 0.0f;
+    return dist_sq / projected;
+}
+
 BoundsDefinition Rectangle3D::get_bounds() const
 {
     Vec3 low_far = A;
@@ -3,7 +3,7 @@
 
 #include "Primitive.h"
 
-class Rectangle3D : public Primitive {
+class Rectangle3D final : public Primitive {
 public:
     Rectangle3D(const Vec3& v1,
                 const Vec3& v2,
@@ -15,8 +15,13 @@ public:
     }
 
     virtual bool hit(const Ray& r, const float t_min, const float t_max, HitRecord& rec) const;
+    virtual bool occluded(const Ray& r, const float t_min, const float t_max) const;
     BoundsDefinition get_bounds() const;
 
+    virtual bool   emits_light() const { return material->emits_light(); }
+    virtual scalar sample_direction(const Vec3& ref_point, Vec3& wi) const;
+    virtual scalar direction_pdf(const Vec3& ref_point, const Vec3& point) const;
+
     Vec3 A;
     Vec3 B;
     Vec3 C;
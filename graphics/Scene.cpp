@@ -1,4 +1,9 @@
 #include "Scene.h"
+#include "ObjLoader.h"
+#include "MeshCache.h"
+
+#include <cmath>
+#include <cstdlib>
 
 Scene::Scene(const std::string& file_path)
 {
@@ -29,8 +34,10 @@ void Scene::read_from_file(const std::string& file_path)
     uint32_t n_materials_so_far    = 0;
 
     const std::initializer_list<std::string> scene_param_keywords = {
-        "NAME", "IMG_WIDTH", "IMG_HEIGHT", "NUM_THREADS", "NUM_SAMPLES", "MAX_RDEPTH"
-        "AMBIENT", "CAM_POS", "CAM_LOOK"
+        "NAME", "IMG_WIDTH", "IMG_HEIGHT", "NUM_THREADS", "NUM_SAMPLES", "MAX_RDEPTH",
+        "RR_DEPTH", "LIGHT_SAMPLING", "MIN_SAMPLES", "ADAPTIVE_THRESHOLD", "TIME_BUDGET",
+        "CHECKPOINT_INTERVAL", "MESH_CACHE", "TEXTURE_CACHE", "SAMPLER", "RAY_PACKETS",
+        "WAVEFRONT", "AMBIENT", "CAM_POS", "CAM_LOOK"
     };
     const std::initializer_list<std::string> material_keywords = {
         "LAMBERTIAN", "METAL", "DIELECTRIC", "TEXTURED", "EMISSIVE"
@@ -67,6 +74,9 @@ void Scene::read_from_file(const std::string& file_path)
 
         // Camera parameters
     }
+    add_primitive_group();
+    build_top_level_bvh();
+    collect_lights();
 }
 
 void Scene::read_scene_materials(const std::string& line)
@@ -162,49 +172,52 @@ void Scene::read_scene_materials(const std::string& line)
 
         // TODO: Enforce specifying at least an albedo map
         // TODO: I/O can be multithreaded especially for large texture files
-        int albedo_idx    = -1;
-        int normal_idx    = -1;
-        int roughness_idx = -1;
-        int ao_idx        = -1;
+        const Texture* albedo_map    = nullptr;
+        const Texture* normal_map    = nullptr;
+        const Texture* roughness_map = nullptr;
+        const Texture* ao_map        = nullptr;
 
+        // Roughness and occlusion only need one channel
         if(!albedo_path.empty())
         {
             std::cout << "[INFO ] Loading color map: " << albedo_path << "...\n";
-            albedo_idx = load_texture_image(albedo_path);
+            albedo_map = load_texture_image(albedo_path, 3);
         }
         if(!normal_path.empty())
         {
             std::cout << "[INFO ] Loading normal map: " << normal_path << "...\n";
-            normal_idx = load_texture_image(normal_path);
+            normal_map = load_texture_image(normal_path, 3);
         }
         if(!roughness_path.empty())
         {
             std::cout << "[INFO ] Loading roughness map: " << roughness_path << "...\n";
-            roughness_idx = load_texture_image(roughness_path);
+            roughness_map = load_texture_image(roughness_path, 1);
         }
         if(!amb_occ_path.empty())
         {
             std::cout << "[INFO ] Loading occlusion map: " << amb_occ_path << "...\n";
-            ao_idx = load_texture_image(amb_occ_path);
+            ao_map = load_texture_image(amb_occ_path, 1);
         }
 
-        std::cout << "[INFO ]    Albedo?    " << (albedo_idx    == -1 ? "No" : "Yes") << "\n"
-                  << "[INFO ]    Normal?    " << (normal_idx    == -1 ? "No" : "Yes") << "\n"
-                  << "[INFO ]    Roughness? " << (roughness_idx == -1 ? "No" : "Yes") << "\n"
-                  << "[INFO ]    Occlusion? " << (ao_idx        == -1 ? "No" : "Yes") << "\n";
-
-        Color* albedo_colors  = textures[albedo_idx].colors.data();
-        Color* normal_colors  = normal_idx    != -1 ? textures[normal_idx].colors.data()   : nullptr;
-        Color* rough_colors   = roughness_idx != -1 ? textures[roughness_idx].colors.data(): nullptr;
-        Color* amb_occ_colors = ao_idx        != -1 ? textures[ao_idx].colors.data() : nullptr;
-
-        material = new Textured(albedo_colors,
-                                normal_colors,
-                                amb_occ_colors,
-                                rough_colors,
-                                is_emissive_flag != 0,
-                                textures[albedo_idx].width,
-                                textures[albedo_idx].height);
+        if(albedo_map == nullptr)
+            throw std::runtime_error("[Error] Please specify at least a color (albedo) map!");
+
+        for(const Texture* map : { normal_map, roughness_map, ao_map })
+        {
+            if(map != nullptr && (map->width != albedo_map->width || map->height != albedo_map->height))
+                throw std::runtime_error("[Error] Texture " + map->path + " is not the same size as its color map");
+        }
+
+        std::cout << "[INFO ]    Albedo?    " << (albedo_map    == nullptr ? "No" : "Yes") << "\n"
+                  << "[INFO ]    Normal?    " << (normal_map    == nullptr ? "No" : "Yes") << "\n"
+                  << "[INFO ]    Roughness? " << (roughness_map == nullptr ? "No" : "Yes") << "\n"
+                  << "[INFO ]    Occlusion? " << (ao_map        == nullptr ? "No" : "Yes") << "\n";
+
+        material = new Textured(albedo_map,
+                                normal_map,
+                                ao_map,
+                                roughness_map,
+                                is_emissive_flag != 0);
     } else
     {
         throw std::runtime_error("[Error] Undefined parameter specified on line: \"" + line + "\"");
@@ -219,7 +232,9 @@ void Scene::read_scene_primitives(const std::string& line)
 
     iss >> dummy;   // consume label
 
-    Mesh* mesh = new Mesh();
+    std::unique_ptr<Mesh> mesh(new Mesh());
+    Transform object_to_world;
+
     if(line.find("p_SPHERE") == 0)
     {
         scalar   center_x, center_y, center_z, radius;
@@ -236,9 +251,9 @@ void Scene::read_scene_primitives(const std::string& line)
                       << "Material: " << material_idx << '\n';
 
             assert(material_idx < materials.size());
-            mesh->add_primitive(new Sphere(Vec3({ center_x, center_y, center_z }), 
-                                           radius, 
-                                           materials[material_idx].get()));
+            add_primitive(mesh.get(), Sphere(Vec3({ center_x, center_y, center_z }), 
+                                             radius, 
+                                             materials[material_idx].get()));
         }
     }
     else if(line.find("p_TRIANGLE") == 0)
@@ -257,10 +272,10 @@ void Scene::read_scene_primitives(const std::string& line)
         std::printf("[INFO ] (Triangle) (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f), Material: %d\n",
                      x1, y1, z1, x2 ,y2, z2, x3, y3, z3, material_idx);
 
-        mesh->add_primitive(new Triangle(Vec3({ x1, y1, z1 }), 
-                                         Vec3({ x2, y2, z2 }), 
-                                         Vec3({ x3, y3, z3 }), 
-                                         materials[material_idx].get()));
+        add_primitive(mesh.get(), Triangle(Vec3({ x1, y1, z1 }), 
+                                           Vec3({ x2, y2, z2 }), 
+                                           Vec3({ x3, y3, z3 }), 
+                                           materials[material_idx].get()));
     }
     else if(line.find("p_RECTANGLE3D") == 0)
     {
@@ -279,11 +294,11 @@ void Scene::read_scene_primitives(const std::string& line)
         std::printf("[INFO ] (Rectangle) (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f) Material: %d\n",
                      x1, y1, z1, x2 ,y2, z2, x3, y3, z3, x4, y4, z4, material_idx);
 
-        mesh->add_primitive(new Rectangle3D(Vec3({ x1, y1, z1 }),
-                                            Vec3({ x2, y2, z2 }),
-                                            Vec3({ x3, y3, z3 }),
-                                            Vec3({ x4, y4, z4 }),
-                                            materials[material_idx].get()));
+        add_primitive(mesh.get(), Rectangle3D(Vec3({ x1, y1, z1 }),
+                                              Vec3({ x2, y2, z2 }),
+                                              Vec3({ x3, y3, z3 }),
+                                              Vec3({ x4, y4, z4 }),
+                                              materials[material_idx].get()));
     }
     else if(line.find("p_PLANE") == 0)
     {
@@ -300,9 +315,9 @@ void Scene::read_scene_primitives(const std::string& line)
         std::printf("[INFO ] (Plane) (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f), Material: %d\n",
                      ox, oy, oz, nx, ny, nz, material_idx);
 
-        mesh->add_primitive(new Plane(Vec3({ ox, oy, oz }),
-                                      Vec3({ nx, ny, nz }),
-                                      materials[material_idx].get()));
+        add_primitive(mesh.get(), Plane(Vec3({ ox, oy, oz }),
+                                        Vec3({ nx, ny, nz }),
+                                        materials[material_idx].get()));
     }
     else if(line.find("OBJ") == 0)
     {
@@ -314,120 +329,146 @@ void Scene::read_scene_primitives(const std::string& line)
         iss >> x1 >> y1 >> z1;
         iss >> path;
 
+        if(!iss || material_idx >= materials.size())
+            throw std::runtime_error("[Error] Invalid OBJ parameters specified");
+
+        // Optional uniform scale and rotation about the Y axis (in degrees),
+        // each of which must parse in full when given
+        auto read_optional = [&iss](scalar& value) {
+            std::string token;
+            if(!(iss >> token))
+                return true;
+            char* end = nullptr;
+            value = std::strtof(token.c_str(), &end);
+            return end == token.c_str() + token.size() && std::isfinite(value);
+        };
+        scalar scale = 1.0f, rotation_y = 0.0f;
+        if(!read_optional(scale) || !read_optional(rotation_y) || scale == 0.0f)
+            throw std::runtime_error("[Error] Invalid OBJ parameters specified");
+
         // Remove " "
         path = path.substr(1, path.length() - 2);
 
-        Vec3 offset = Vec3({ x1, y1, z1 });
-        load_3d_obj_from_file(path, offset, mesh, materials[material_idx].get());
-    }
-    meshes.push_back(std::unique_ptr<Mesh>(mesh));
-}
+        object_to_world = Transform::translate(Vec3({ x1, y1, z1 })) *
+                          Transform::rotate_y(rotation_y) *
+                          Transform::scale(scale);
 
-void Scene::load_3d_obj_from_file(const std::string& path, const Vec3& offset, Mesh* mesh, Material* mat)
-{
-    std::ifstream input_file(path);
-    if(!input_file)
-        throw std::runtime_error("[Error] Could not find the file specified: " + path);
+        // The same model and material is only ever loaded once
+        const std::string key = path + '#' + std::to_string(material_idx);
+        auto cached = obj_meshes.find(key);
+        if(cached != obj_meshes.end())
+        {
+            std::cout << "[INFO ] Instancing already loaded obj file: " << path << '\n';
+            add_instance(cached->second, object_to_world);
+            return;
+        }
 
-    int num_vertices = 0;
-    int num_normals  = 0;
+        load_3d_obj_from_file(path, mesh.get(), materials[material_idx].get());
+        obj_meshes[key] = mesh.get();
+    }
 
-    std::string line;
+    // Grouped primitives are placed in the scene all at once later on
+    if(mesh->primitives.empty())
+        return;
 
-    while(std::getline(input_file, line))
+    mesh->build_bvh();
+    add_instance(mesh.get(), object_to_world);
+    meshes.push_back(std::move(mesh));
+}
+
+template <typename T>
+void Scene::add_primitive(Mesh* mesh, const T& primitive)
+{
+    if(!group_primitives)
     {
-        if(line.find("v ") == 0)  num_vertices++; 
-        if(line.find("vn ") == 0) num_normals++;
+        mesh->add_primitive(new T(primitive));
+        return;
     }
-    mesh->reserve_n_primitives(num_vertices / 3);
 
-    input_file.clear();
-    input_file.seekg(0);
+    if(primitive_group == nullptr)
+        primitive_group = new PrimitiveGroup();
+    primitive_group->add(primitive);
+}
 
-    int num_poly = 0;
+void Scene::add_primitive_group()
+{
+    if(primitive_group == nullptr)
+        return;
 
-    int tri_indices[3];
-    int verts_read_so_far = 0;
+    primitive_group->build();
 
-    int nrm_indices[3];
-    int norms_read_so_far = 0;
+    std::unique_ptr<Mesh> mesh(new Mesh());
+    mesh->add_primitive(primitive_group);
+    mesh->build_bvh();
+    add_instance(mesh.get(), Transform());
+    meshes.push_back(std::move(mesh));
+}
 
-    std::vector<Vec3> vertices       = {};
-    std::vector<Vec3> vertex_normals = {};
+void Scene::add_instance(const Mesh* mesh, const Transform& object_to_world)
+{
+    if(mesh->bvh.empty())
+        return;
 
-    vertices.reserve(num_vertices);
-    vertex_normals.reserve(num_normals);
+    instances.push_back(std::unique_ptr<MeshInstance>(new MeshInstance(mesh, object_to_world)));
 
-    std::string dummy_str;
+    MeshInstance* instance = instances.back().get();
+    if(instance->is_unbounded())
+        unbounded_instances.push_back(instance);
+    else
+        bounded_instances.push_back(instance);
+}
 
-    // To consume unneeded fields for now
-    char slash;
+void Scene::collect_lights()
+{
+    lights.clear();
 
-    std::cout << "Reading obj file: " << path << '\n';
-    int num_lines = 0;
-    while(std::getline(input_file, line))
+    // Meshes loaded from .OBJ files are the only ones placed with a
+    // transform, and a TriangleMesh is never sampled as a light
+    for(const auto& mesh : meshes)
     {
-        if(line[0] == '#') 
-            continue;
-
-        std::istringstream istr(line);
-
-        // Reading a vertex
-        if(line.find("v ") == 0)
+        for(const Primitive* primitive : mesh->primitives)
         {
-            istr >> slash;
-            float x_pos, y_pos, z_pos;
-            istr >> x_pos >> y_pos >> z_pos;
-            vertices.push_back(0.25 * Vec3({ x_pos, y_pos, z_pos }));
+            if(primitive->emits_light())
+                lights.push_back(primitive);
         }
+    }
+    if(primitive_group != nullptr)
+        primitive_group->collect_lights(lights);
 
-        if(line.find("vn ") == 0)
-        {
-            std::istringstream nrm(line.substr(2));
-
-            float x_nrm, y_nrm, z_nrm;
-            nrm >> x_nrm >> y_nrm >> z_nrm;
-            vertex_normals.push_back(normalize(Vec3({ x_nrm, y_nrm, z_nrm })));
-        }
+    std::cout << "[INFO ] " << lights.size() << " lights\n";
+}
 
-        // Reading a face
-        if(line.find("f ") == 0)
-        {
-            std::string field;
-            istr >> field;      // consume 'f'
-            while(verts_read_so_far < 3)
-            {
-                istr >> tri_indices[verts_read_so_far++];
-
-                if(!std::isspace(istr.peek()))
-                {
-                    istr >> slash;      // consume '/'
-                    istr >> slash;      // consume '/'
-                    istr >> nrm_indices[norms_read_so_far++];      // vertex normal index
-                }
-            }
+void Scene::build_top_level_bvh()
+{
+    top_level_bvh.build(bounded_instances);
+    std::cout << "[INFO ] " << meshes.size() << " meshes, " 
+              << instances.size() << " instances\n";
+}
 
-            if(verts_read_so_far == 3)
-            {
-                Triangle* tri = new Triangle(vertices[tri_indices[0] - 1] + offset,
-                                             vertices[tri_indices[1] - 1] + offset,
-                                             vertices[tri_indices[2] - 1] + offset,
-                                             mat);
+void Scene::load_3d_obj_from_file(const std::string& path, Mesh* mesh, Material* mat)
+{
+    // All of the faces go into a single packed triangle mesh
+    TriangleMesh* triangles = new TriangleMesh(mat);
+    mesh->add_primitive_no_recalc(triangles);
 
-                tri->a_nrm = vertex_normals[nrm_indices[0] - 1];
-                tri->b_nrm = vertex_normals[nrm_indices[1] - 1];
-                tri->c_nrm = vertex_normals[nrm_indices[2] - 1];
+    if(use_mesh_cache && MeshCache::load(path, *triangles))
+        std::cout << "Read cached obj file: " << MeshCache::cache_path(path) << '\n';
+    else
+    {
+        std::cout << "Reading obj file: " << path << '\n';
+        load_obj(path, *triangles);
 
-                mesh->add_primitive_no_recalc(tri);
-                num_poly++;
+        for(Vec3& vertex : triangles->vertices)
+            vertex = 0.25 * vertex;
+        triangles->build();
 
-                verts_read_so_far = 0;
-                norms_read_so_far = 0;
-            } 
-        }
-        num_lines++;
+        if(use_mesh_cache && !MeshCache::save(path, *triangles))
+            std::cerr << "[WARNING] Could not write the cache of: " << path << '\n';
     }
-    mesh->calculate_bounding_faces();
+
+    std::cout << "[INFO ] " << triangles->vertices.size() << " vertices, "
+              << triangles->num_triangles() << " triangles\n";
+    mesh->calculate_bounds();
 }
 
 void Scene::read_scene_parameters(const std::string& line)
@@ -480,6 +521,74 @@ void Scene::read_scene_parameters(const std::string& line)
         if(!(iss >> max_recursion_depth))
             throw std::runtime_error("[Error] Invalid parameter specified for MAX_RDEPTH");
     }
+    else if (line.find("RR_DEPTH") == 0)
+    {
+        if(!(iss >> russian_roulette_depth))
+            throw std::runtime_error("[Error] Invalid parameter specified for RR_DEPTH");
+    }
+    else if (line.find("MIN_SAMPLES") == 0)
+    {
+        if(!(iss >> min_samples))
+            throw std::runtime_error("[Error] Invalid parameter specified for MIN_SAMPLES");
+    }
+    else if (line.find("ADAPTIVE_THRESHOLD") == 0)
+    {
+        if(!(iss >> adaptive_threshold) || adaptive_threshold < 0)
+            throw std::runtime_error("[Error] Invalid parameter specified for ADAPTIVE_THRESHOLD");
+    }
+    else if (line.find("TIME_BUDGET") == 0)
+    {
+        if(!(iss >> time_budget) || time_budget < 0)
+            throw std::runtime_error("[Error] Invalid parameter specified for TIME_BUDGET");
+    }
+    else if (line.find("MESH_CACHE") == 0)
+    {
+        if(!(iss >> use_mesh_cache))
+            throw std::runtime_error("[Error] Invalid parameter specified for MESH_CACHE");
+    }
+    else if (line.find("TEXTURE_CACHE") == 0)
+    {
+        scalar budget_mb;
+        if(!(iss >> budget_mb) || budget_mb < 0)
+            throw std::runtime_error("[Error] Invalid parameter specified for TEXTURE_CACHE");
+        if(!textures.empty())
+            throw std::runtime_error("[Error] TEXTURE_CACHE must be specified before any textured materials");
+
+        texture_cache.reset();
+        if(budget_mb > 0)
+            texture_cache = std::make_unique<TextureCache>(std::size_t(double(budget_mb) * 1024.0 * 1024.0));
+    }
+    else if (line.find("SAMPLER") == 0)
+    {
+        std::string sequence;
+        iss >> sequence;
+        if(sequence == "sobol")
+            sampler_type = Sampler::Type::SOBOL;
+        else if(sequence == "independent")
+            sampler_type = Sampler::Type::INDEPENDENT;
+        else
+            throw std::runtime_error("[Error] Invalid parameter specified for SAMPLER, expected sobol or independent");
+    }
+    else if (line.find("RAY_PACKETS") == 0)
+    {
+        if(!(iss >> packet_size) || packet_size * packet_size > RayPacket::MAX_SIZE)
+            throw std::runtime_error("[Error] Invalid parameter specified for RAY_PACKETS, expected 0, 8 or 16");
+    }
+    else if (line.find("WAVEFRONT") == 0)
+    {
+        if(!(iss >> wavefront))
+            throw std::runtime_error("[Error] Invalid parameter specified for WAVEFRONT");
+    }
+    else if (line.find("CHECKPOINT_INTERVAL") == 0)
+    {
+        if(!(iss >> checkpoint_interval) || checkpoint_interval < 0)
+            throw std::runtime_error("[Error] Invalid parameter specified for CHECKPOINT_INTERVAL");
+    }
+    else if (line.find("LIGHT_SAMPLING") == 0)
+    {
+        if(!(iss >> sample_lights))
+            throw std::runtime_error("[Error] Invalid parameter specified for LIGHT_SAMPLING");
+    }
     else if (line.find("CAM_POS") == 0)
     {
         if(!(iss >> camera_pos[0] >> camera_pos[1] >> camera_pos[2]))
@@ -509,49 +618,86 @@ bool Scene::anything_hit(const Ray& r, const scalar t_min, const scalar t_max, H
     scalar closest      = t_max;
     bool hit_anything  = false;
 
-    HitRecord bv_rec   = {};    // Not really useful since only hit/no hit matters
-
-    for(const auto& mesh : meshes)
+    if(top_level_bvh.hit(bounded_instances, r, t_min, closest, temp_rec))
     {
-        bool intersects_bv = false;
+        closest      = temp_rec.t;
+        rec          = temp_rec;
+        hit_anything = true;
+    }
 
-        // Don't bother checking with each face of the bounding box if there
-        // are fewer primitives than there are faces of the bounding box
-        if(mesh->primitives.size() > mesh->bounding_volume_faces.size())
-        {
-            for(const auto& face : mesh->bounding_volume_faces)
-            {
-                // Not using FLT_MAX causes farther objects to be 'cut off'
-                // because a bounding box face is nearer even though the 
-                // area itself may be empty enough to see the further object
-                if(face->hit(r, t_min, FLT_MAX, bv_rec))  
-                {
-                    intersects_bv = true;
-                    break;
-                }
-            }
-        } else
-            intersects_bv = true; // Go straight to intersection check against primitives
-
-        /**
-         * If so, then check hit with each of the primitives 
-         * Hitting a bounding volume does not necessarily mean the ray hits a primitive 
-         * if so, this is a false positive, which is fine
-         **/
-        if(intersects_bv)
+    for(const Primitive* instance : unbounded_instances)
+    {
+        if(instance->hit(r, t_min, closest, temp_rec))
         {
-            for(const Primitive* prim : mesh->primitives)
+            closest      = temp_rec.t;
+            rec          = temp_rec;
+            hit_anything = true;
+        }
+    }
+    return hit_anything;
+}
+
+void Scene::anything_hit_packet(RayPacket& packet, const scalar t_min, HitRecord* recs) const
+{
+    uint32_t all_rays[RayPacket::MAX_SIZE];
+    for(uint32_t i = 0; i < packet.count; i++)
+        all_rays[i] = i;
+
+    top_level_bvh.traverse_packet(packet, t_min, 0,
+        [&](const BVHNode& leaf, const uint32_t* active, const uint32_t num_active) {
+            for(uint32_t i = 0; i < leaf.prim_count; i++)
             {
-                if(prim->hit(r, t_min, closest, temp_rec))
-                {
-                    closest      = temp_rec.t;
-                    rec          = temp_rec;
-                    hit_anything = true;
-                }
+                const Primitive* instance = bounded_instances[top_level_bvh.prim_indices[leaf.left_first + i]];
+                instance->hit_packet(packet, active, num_active, t_min, recs);
             }
-        } // Else, no hit
+        });
+
+    for(const Primitive* instance : unbounded_instances)
+        instance->hit_packet(packet, all_rays, packet.count, t_min, recs);
+}
+
+bool Scene::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    // Unbounded primitives, i.e., planes, are the most likely blockers
+    for(const Primitive* instance : unbounded_instances)
+    {
+        if(instance->occluded(r, t_min, t_max))
+            return true;
     }
-    return hit_anything;
+    return top_level_bvh.occluded(bounded_instances, r, t_min, t_max);
+}
+
+bool Scene::sample_light(const Vec3& point, Vec3& wi, Color& emitted, scalar& pdf) const
+{
+    if(lights.empty())
+        return false;
+
+    const uint32_t   n_lights = lights.size();
+    const Primitive* light    = lights[std::min(n_lights - 1, uint32_t(random_scalar() * n_lights))];
+
+    pdf = light->sample_direction(point, wi);
+    if(!(pdf > 0))
+        return false;
+
+    // Trace the light alone for the uv and side of the sampled point, then
+    // check that nothing else lies in between
+    const Ray shadow_ray(point, wi);
+    HitRecord light_rec = {};
+    if(!light->hit(shadow_ray, 1e-3, FLT_MAX, light_rec))
+        return false;
+    if(occluded(shadow_ray, 1e-3, light_rec.t - 1e-3))
+        return false;
+
+    emitted = light_rec.material_ptr->emitted(light_rec.uv);
+    pdf    /= scalar(n_lights);
+    return true;
+}
+
+scalar Scene::light_pdf(const Vec3& point, const HitRecord& light_rec) const
+{
+    if(lights.empty() || light_rec.primitive == nullptr || !light_rec.primitive->emits_light())
+        return 0.0f;
+    return light_rec.primitive->direction_pdf(point, light_rec.point_at_t) / scalar(lights.size());
 }
 
 // Keep this for now for future testing
@@ -561,16 +707,13 @@ bool Scene::anything_hit_by_ray(const Ray&  r, const scalar t_min, const scalar
     scalar closest      = t_max;
     bool hit_anything  = false;
 
-    for(const auto& m : meshes)
+    for(const auto& instance : instances)
     {
-        for(const auto& obj : m->primitives)
+        if(instance->hit(r, t_min, closest, temp_rec))
         {
-            if(obj->hit(r, t_min, closest, temp_rec))
-            {
-                closest      = temp_rec.t;
-                rec          = temp_rec;
-                hit_anything = true;
-            }
+            closest      = temp_rec.t;
+            rec          = temp_rec;
+            hit_anything = true;
         }
     }
     return hit_anything;
@@ -581,43 +724,23 @@ Scene::~Scene()
 {
 }
 
-std::vector<Color> convert_bmp_to_vec3(uint8_t* pixel_bytes, const uint32_t tex_width, const uint32_t tex_height)
-{
-    const scalar denom  = 1 / scalar(256);
-    uint8_t* curr_byte = pixel_bytes;
-
-    std::vector<Color> colors = {};
-    colors.reserve(tex_width * tex_height);
-
-    for(uint32_t y = 0; y < tex_height; y++)
-    {
-        for(uint32_t x = 0; x < tex_width; x++)
-        {
-            Vec3 a = Vec3({ scalar(*(curr_byte + 2)) * denom,
-                            scalar(*(curr_byte + 1)) * denom,
-                            scalar(*(curr_byte + 0)) * denom });
-            colors.push_back(a);
-
-            curr_byte += 3;
-        }
-    }
-    return colors;
-}
-
-int Scene::load_texture_image(const std::string& path)
+const Texture* Scene::load_texture_image(const std::string& path, const uint32_t channels)
 {
-    textures.push_back(TextureImage{});
-    TextureImage& texture = textures[textures.size() - 1];
-
-    texture.file_path = path;
-    texture.pixels = read_from_bmp_file(texture.file_path.c_str(),
-                                        &texture.width,
-                                        &texture.height,
-                                        &texture.bytes_per_pixel); 
-    if(texture.pixels == nullptr)
-        throw std::runtime_error("[Error] Could not read image file: " + path);
-
-    texture.colors = convert_bmp_to_vec3(texture.pixels.get(), texture.width, texture.height);
-    return textures.size() - 1;
+    const std::string key = path + '#' + std::to_string(channels);
+    const auto found = texture_files.find(key);
+    if(found != texture_files.end())
+        return found->second;
+
+    textures.push_back(std::make_unique<Texture>(path, channels, texture_cache.get()));
+    const Texture* texture = textures.back().get();
+    texture_files[key] = texture;
+
+    std::cout << "[INFO ]    " << texture->width << " x " << texture->height << ", "
+              << channels << (channels == 1 ? " channel, " : " channels, ");
+    if(texture->is_paged())
+        std::cout << "paged from " << Texture::tiled_path(path, channels) << '\n';
+    else
+        std::cout << texture->size_in_bytes() / 1024 << " KB\n";
+    return texture;
 }
 
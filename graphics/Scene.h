@@ -2,32 +2,22 @@
 #define GRAPHICS_WORLD_H
 
 #include "Triangle.h"
+#include "TriangleMesh.h"
 #include "Rectangle3D.h"
 #include "Sphere.h"
 #include "Primitive.h"
 #include "Mesh.h"
+#include "MeshInstance.h"
 #include "Plane.h"
-
-#include "../util/BitmapImage.h"
+#include "PrimitiveGroup.h"
+#include "BVH.h"
+#include "Texture.h"
 
 #include <sstream>
 #include <fstream>
 #include <vector>
 #include <cfloat>
-
-struct TextureImage {
-    uint32_t width;
-    uint32_t height;
-    uint32_t bytes_per_pixel;
-
-    std::string file_path;
-    std::vector<Color> colors;       // Floating-point color values used by raytracer
-    std::unique_ptr<uint8_t> pixels; // Actual file byte representation
-
-    TextureImage() = default;
-};
-
-std::vector<Color> convert_bmp_to_vec3(uint8_t*, const uint32_t, const uint32_t);
+#include <map>
 
 class Scene {
 public:
@@ -42,6 +32,37 @@ public:
                       const scalar t_max, 
                       HitRecord&  rec) const;
 
+    /**
+     * Any-hit query for shadow and occlusion rays, true as soon as anything
+     * is found between t_min and t_max, without filling in a HitRecord
+     **/
+    bool occluded(const Ray&   r,
+                  const scalar t_min,
+                  const scalar t_max) const;
+
+    /**
+     * anything_hit() for every ray of a packet at once. Those which hit
+     * something have their packet.t_max lowered from FLT_MAX to the
+     * nearest hit, described by recs[i]
+     **/
+    void anything_hit_packet(RayPacket&   packet,
+                             const scalar t_min,
+                             HitRecord*   recs) const;
+
+    /**
+     * Next event estimation. Picks one of the lights uniformly and a
+     * direction wi towards it from point. If the light is visible, returns
+     * true along with its emitted radiance and the pdf of wi with respect
+     * to solid angle, which accounts for the choice of light
+     **/
+    bool sample_light(const Vec3& point,
+                      Vec3&       wi,
+                      Color&      emitted,
+                      scalar&     pdf) const;
+
+    // The pdf with which sample_light() would have picked light_rec from point
+    scalar light_pdf(const Vec3& point, const HitRecord& light_rec) const;
+
     // TODO: keep this for now for future performance testing
     bool anything_hit_by_ray(const Ray&  r, 
                              const scalar t_min, 
@@ -55,10 +76,59 @@ public:
     // Deallocate scene objects
     ~Scene();
 
+    /**
+     * If set, the built-in primitives of the scene file are kept by value
+     * in a single PrimitiveGroup instead of each being an individually 
+     * allocated Primitive* in its own Mesh. Must be set before reading
+     **/
+    bool group_primitives = true;
+
     std::vector<std::unique_ptr<Material>> materials;
     std::vector<std::unique_ptr<Mesh>>     meshes;
 
-    std::vector<TextureImage > textures;
+    /**
+     * Every mesh is placed in the world through at least one instance,
+     * the bounded ones are the leaves of the top-level BVH while the 
+     * unbounded ones (i.e., planes) are always tested
+     **/
+    std::vector<std::unique_ptr<MeshInstance>> instances;
+    std::vector<Primitive*> bounded_instances;
+    std::vector<Primitive*> unbounded_instances;
+    BVH top_level_bvh;
+
+    // Primitives with an emissive material which support area sampling
+    std::vector<const Primitive*> lights;
+
+    // Whether paths sample the lights directly at each diffuse bounce
+    bool sample_lights = true;
+
+    // Sequence the random numbers of each pixel's samples are drawn from
+    Sampler::Type sampler_type = Sampler::Type::SOBOL;
+
+    /**
+     * Side of the blocks of pixels whose camera rays are traced together
+     * as one RayPacket, 0 to trace every ray alone. Later bounces always
+     * are
+     **/
+    uint32_t packet_size = 8;
+
+    /**
+     * Whether a tile's paths are traced together, a bounce at a time, and
+     * shaded in batches of one material each (see Wavefront) rather than
+     * one path after another
+     **/
+    bool wavefront = false;
+
+    // Whether .OBJ models are loaded from, and saved to, a MeshCache
+    bool use_mesh_cache = true;
+
+    /**
+     * Given a budget (TEXTURE_CACHE, in MB, before any materials) textures
+     * are not held in memory but paged in through this cache as they are
+     * sampled, so that they take no more than the budget all together
+     **/
+    std::unique_ptr<TextureCache>         texture_cache;
+    std::vector<std::unique_ptr<Texture>> textures;
 
     std::string name = "output";
     uint32_t image_width;
@@ -66,21 +136,58 @@ public:
     uint32_t num_samples;
     uint32_t num_threads;
 
+    /**
+     * Adaptive sampling, tiles stop once the relative error of their pixels
+     * is below adaptive_threshold (0 to disable) after at least min_samples,
+     * and num_samples becomes the cap. A time budget (in seconds, 0 for none)
+     * ends the render early with however many samples were taken by then.
+     * Every checkpoint_interval seconds (0 for never) the progress so far
+     * is saved, so that an interrupted render can be resumed
+     **/
+    uint32_t min_samples         = 16;
+    scalar   adaptive_threshold  = 0.0f;
+    scalar   time_budget         = 0.0f;
+    scalar   checkpoint_interval = 0.0f;
+
     Vec3 ambient = Vec3({ 0.0, 0.0, 0.0 });
     
     uint32_t num_render_threads;
     
     uint32_t max_recursion_depth = 32;
+    uint32_t russian_roulette_depth = 5;  // Bounce after which paths may be ended at random
     uint32_t tile_size = 64;
     Vec3  camera_pos   = Vec3({ 0.0, 0.0,  0.0 });
     Vec3  camera_look  = Vec3({ 0.0, 0.0, -1.0 });
     scalar camera_fov   = 45.0f;
+
+    // Angle between the primary rays of neighbouring pixels, i.e. the spread of their ray cones
+    inline scalar pixel_spread_angle() const
+    {
+        return std::atan(2.0f * std::tan(camera_fov * k_PI / 360.0f) / scalar(image_height));
+    }
 private:
-    int  load_texture_image   (const std::string& path);
+    const Texture* load_texture_image(const std::string& path, const uint32_t channels);
     void read_scene_parameters(const std::string& line);
     void read_scene_primitives(const std::string& line);
     void read_scene_materials (const std::string& line);
-    void load_3d_obj_from_file(const std::string& path, const Vec3& offset, Mesh* mesh, Material* mat);
+    void load_3d_obj_from_file(const std::string& path, Mesh* mesh, Material* mat);
+    void add_instance         (const Mesh* mesh, const Transform& object_to_world);
+    void add_primitive_group  ();
+    void collect_lights       ();
+
+    template <typename T>
+    void add_primitive(Mesh* mesh, const T& primitive);
+
+    // Owned by its Mesh once the scene file has been read
+    PrimitiveGroup* primitive_group = nullptr;
+    void build_top_level_bvh  ();
+
+    // Meshes loaded from .OBJ files, keyed by path and material index,
+    // so that repeated references only create another instance
+    std::map<std::string, const Mesh*> obj_meshes;
+
+    // Likewise textures, keyed by path and number of channels
+    std::map<std::string, const Texture*> texture_files;
 };
 
 #endif
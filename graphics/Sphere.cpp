@@ -17,11 +17,13 @@ bool Sphere::hit(const Ray& r, const scalar t_min, const scalar t_max, HitRecord
             rec.point_at_t   = r.point_at_t(temp);
             rec.normal       = (rec.point_at_t - center) / radius;
             rec.material_ptr = material;
+            rec.primitive    = this;
             
             // Convert cartesian -> spherical -> UV
             scalar theta = atan2f(-rec.normal.z(), rec.normal.x()) + k_PI;
             scalar phi   = 0.5 + asinf(clamp(rec.normal.y(), -1.0f, 1.0f)) / k_PI;
             rec.uv = Vec2({ theta / (2.0f * k_PI), phi });
+            rec.uv_density = uv_density(rec.normal);
 
             rec.tangent   = -normalize(cross(rec.normal, Vec3({ 0.0, 1.0, 0.0 })));
             rec.bitangent =  cross(rec.normal, rec.tangent);
@@ -35,11 +37,13 @@ bool Sphere::hit(const Ray& r, const scalar t_min, const scalar t_max, HitRecord
             rec.point_at_t   = r.point_at_t(temp);
             rec.normal       = (rec.point_at_t - center) / radius;
             rec.material_ptr = material;
+            rec.primitive    = this;
 
             // Convert cartesian -> spherical -> UV
             scalar theta = atan2f(-rec.normal.z(), rec.normal.x()) + k_PI;
             scalar phi   = 0.5 + asinf(clamp(rec.normal.y(), -1.0f, 1.0f)) / k_PI;
             rec.uv = Vec2({ theta / (2.0f * k_PI), phi });
+            rec.uv_density = uv_density(rec.normal);
 
             rec.tangent   = -normalize(cross(rec.normal, Vec3({ 0.0f, 1.0f, 0.0f })));
             rec.bitangent =  cross(rec.normal, rec.tangent);
@@ -50,6 +54,69 @@ bool Sphere::hit(const Ray& r, const scalar t_min, const scalar t_max, HitRecord
     return false;
 }
 
+bool Sphere::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    Vec3 oc = r.origin() - center;
+    scalar a = dot(r.direction(), r.direction());
+    scalar b = 2.0 * dot(oc, r.direction());
+    scalar c = dot(oc, oc) - radius * radius;
+    scalar discriminant = b * b - (4 * a * c);
+
+    if(discriminant <= 0)
+        return false;
+
+    const scalar sqrt_disc = sqrt(discriminant);
+    const scalar near_t    = (-b - sqrt_disc) / (2.0 * a);
+    const scalar far_t     = (-b + sqrt_disc) / (2.0 * a);
+    return (t_min < near_t && near_t < t_max) || (t_min < far_t && far_t < t_max);
+}
+
+scalar Sphere::sample_direction(const Vec3& ref_point, Vec3& wi) const
+{
+    const Vec3   to_center = center - ref_point;
+    const scalar dist_sq   = to_center.magnitude_squared();
+
+    // From inside, pick a point uniformly over the whole surface
+    if(dist_sq <= radius * radius)
+    {
+        const Vec3 point = center + radius * sample_uniform_sphere(random_2d());
+        wi = point - ref_point;
+        if(wi.magnitude_squared() == 0)
+            return 0.0f;
+        wi.normalize();
+        return direction_pdf(ref_point, point);
+    }
+
+    // From outside, pick a direction uniformly within the cone subtended
+    // by the sphere, so that no sample lands on the far side. 1 - cos_max
+    // is computed as sin^2 / (1 + cos) so that it survives distant spheres
+    const scalar sin2_max = radius * radius / dist_sq;
+    const scalar cos_max  = std::sqrt(std::max<scalar>(0.0f, 1 - sin2_max));
+    const scalar cone     = sin2_max / (1 + cos_max);
+
+    const Frame frame(to_center / std::sqrt(dist_sq));
+    wi = normalize(frame.to_world(sample_uniform_cone(random_2d(), cone)));
+    return uniform_cone_pdf(cone);
+}
+
+scalar Sphere::direction_pdf(const Vec3& ref_point, const Vec3& point) const
+{
+    const scalar dist_sq = (center - ref_point).magnitude_squared();
+    if(dist_sq > radius * radius)
+    {
+        const scalar sin2_max = radius * radius / dist_sq;
+        const scalar cos_max  = std::sqrt(std::max<scalar>(0.0f, 1 - sin2_max));
+        return 1.0f / (2 * k_PI * sin2_max / (1 + cos_max));
+    }
+
+    // Area pdf converted to solid angle
+    const Vec3   to_point = point - ref_point;
+    const scalar cosine   = std::fabs(dot(point - center, to_point)) / (radius * to_point.magnitude());
+    if(cosine < 1e-6)
+        return 0.0f;
+    return to_point.magnitude_squared() / (cosine * 4 * k_PI * radius * radius);
+}
+
 BoundsDefinition Sphere::get_bounds() const
 {
     return BoundsDefinition {
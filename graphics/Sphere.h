@@ -3,7 +3,7 @@
 
 #include "Primitive.h"
 
-class Sphere : public Primitive {
+class Sphere final : public Primitive {
 public:
     Sphere() {}
 
@@ -17,8 +17,24 @@ public:
     }
 
     virtual bool hit(const Ray& r, const float t_min, const float t_max, HitRecord& rec) const;
+    virtual bool occluded(const Ray& r, const float t_min, const float t_max) const;
     BoundsDefinition get_bounds() const;
+
+    virtual bool   emits_light() const { return material->emits_light(); }
+    virtual scalar sample_direction(const Vec3& ref_point, Vec3& wi) const;
+    virtual scalar direction_pdf(const Vec3& ref_point, const Vec3& point) const;
 private:
+    /**
+     * Texture area per unit of surface area at the point with the given
+     * unit normal. The longitude spans 2 pi r cos(latitude) and the
+     * latitude pi r of the unit square of texture coordinates
+     **/
+    inline scalar uv_density(const Vec3& normal) const
+    {
+        const scalar cos_latitude = std::sqrt(std::max(0.0f, 1.0f - normal.y() * normal.y()));
+        return 1.0f / (2.0f * k_PI * k_PI * radius * radius * std::max(cos_latitude, 0.01f));
+    }
+
     Vec3      center = Vec3();
     float     radius = 0.0f;
     Material* material = nullptr;
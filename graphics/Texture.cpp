@@ -0,0 +1,377 @@
+#include "Texture.h"
+#include "../util/BitmapImage.h"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+namespace
+{
+    /**
+     * Texels of a row (or column) of size texels covered by each texel of
+     * one of next_size texels, and how much, so that every texel of the
+     * larger level counts equally also when the size is odd
+     **/
+    struct BoxTaps
+    {
+        uint32_t first;
+        uint32_t count;
+        scalar   weights[3];
+    };
+
+    std::vector<BoxTaps> box_filter_taps(const uint32_t size, const uint32_t next_size)
+    {
+        const double scale = double(size) / double(next_size);
+
+        std::vector<BoxTaps> taps(next_size);
+        for(uint32_t i = 0; i < next_size; i++)
+        {
+            const double lower = i * scale;
+            const double upper = (i + 1) * scale;
+
+            BoxTaps& tap = taps[i];
+            tap.first = uint32_t(lower);
+            tap.count = 0;
+            for(uint32_t j = tap.first; j < upper && j < size && tap.count < 3; j++)
+                tap.weights[tap.count++] = scalar((std::min(upper, j + 1.0) - std::max(lower, double(j))) / scale);
+        }
+        return taps;
+    }
+
+    constexpr uint32_t TILED_TEXTURE_MAGIC   = 0x58545452;   // "RTTX" read as little endian
+    constexpr uint32_t TILED_TEXTURE_VERSION = 1;
+    constexpr uint64_t TILED_TEXTURE_ALIGNMENT = 4096;
+
+    bool source_info(const std::string& path, uint64_t& size, int64_t& mtime)
+    {
+        std::error_code error;
+        size  = std::filesystem::file_size(path, error);
+        if(error)
+            return false;
+        mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        return !error;
+    }
+}
+
+std::string Texture::tiled_path(const std::string& source_path, const uint32_t channels)
+{
+    return source_path + (channels == 1 ? ".r.rttex" : ".rgb.rttex");
+}
+
+Texture::Texture(const std::string& file_path, const uint32_t num_channels, TextureCache* texture_cache):
+    path    (file_path),
+    channels(num_channels)
+{
+    if(channels != 1 && channels != 3)
+        throw std::runtime_error("[Error] Textures have either 1 or 3 channels, not " + std::to_string(channels));
+
+    const std::string tiled_file  = tiled_path(path, channels);
+    uint64_t          data_offset = 0;
+
+    if(texture_cache == nullptr || !read_tiled(tiled_file, data_offset))
+    {
+        load_image();
+        if(texture_cache == nullptr)
+            return;
+
+        if(!write_tiled(tiled_file, data_offset))
+        {
+            std::cout << "[WARNING] Could not write " << tiled_file << ", keeping the texture in memory\n";
+            return;
+        }
+        std::vector<uint8_t>().swap(texels);
+    }
+
+    cache   = texture_cache;
+    file_id = cache->add_file(tiled_file, data_offset, page_bytes());
+}
+
+void Texture::load_image()
+{
+    uint32_t bytes_per_pixel = 0;
+    std::unique_ptr<uint8_t[]> pixels = read_from_bmp_file(path.c_str(), &width, &height, &bytes_per_pixel);
+    if(pixels == nullptr)
+        throw std::runtime_error("[Error] Could not read image file: " + path);
+    if(bytes_per_pixel != 3 && bytes_per_pixel != 4)
+        throw std::runtime_error("[Error] Only 24 and 32-bit images can be used as textures: " + path);
+    if(width == 0 || height == 0)
+        throw std::runtime_error("[Error] Texture has no pixels: " + path);
+
+    // Pixels are stored as BGR(A), the file's buffer is freed once they are reordered
+    std::vector<uint8_t> level_texels(std::size_t(width) * height * channels);
+    const uint8_t* pixel = pixels.get();
+    for(std::size_t i = 0; i < std::size_t(width) * height; i++)
+    {
+        level_texels[i * channels] = pixel[2];
+        if(channels == 3)
+        {
+            level_texels[i * channels + 1] = pixel[1];
+            level_texels[i * channels + 2] = pixel[0];
+        }
+        pixel += bytes_per_pixel;
+    }
+    pixels.reset();
+
+    // Lay out every level in whole pages
+    std::size_t num_pages = 0;
+    for(uint32_t w = width, h = height; ; w = (w + 1) / 2, h = (h + 1) / 2)
+    {
+        const uint32_t pages_x = (w + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        const uint32_t pages_y = (h + PAGE_SIZE - 1) >> PAGE_SHIFT;
+        levels.push_back(MipLevel{ w, h, pages_x, 0, num_pages });
+        num_pages += std::size_t(pages_x) * pages_y;
+
+        if(w == 1 && h == 1)
+            break;
+    }
+    texels.resize(num_pages * page_bytes());
+
+    for(std::size_t l = 0; l < levels.size(); l++)
+    {
+        const MipLevel& level = levels[l];
+        for(uint32_t y = 0; y < level.height; y++)
+        {
+            for(uint32_t x = 0; x < level.width; x++)
+            {
+                const uint8_t* src = &level_texels[(std::size_t(y) * level.width + x) * channels];
+                uint8_t*       dst = &texels[page_index(level, x, y) * page_bytes() + texel_in_page(x, y) * channels];
+                std::copy(src, src + channels, dst);
+            }
+        }
+        if(l + 1 == levels.size())
+            break;
+
+        // Box filter down to the next level, whose size is rounded up so
+        // that an odd sized level spreads its texels over the smaller one
+        const MipLevel& next = levels[l + 1];
+        const std::vector<BoxTaps> x_taps = box_filter_taps(level.width,  next.width);
+        const std::vector<BoxTaps> y_taps = box_filter_taps(level.height, next.height);
+
+        std::vector<uint8_t> next_texels(std::size_t(next.width) * next.height * channels);
+        for(uint32_t y = 0; y < next.height; y++)
+        {
+            const BoxTaps& y_tap = y_taps[y];
+            for(uint32_t x = 0; x < next.width; x++)
+            {
+                const BoxTaps& x_tap = x_taps[x];
+                for(uint32_t c = 0; c < channels; c++)
+                {
+                    scalar sum = 0.0f;
+                    for(uint32_t j = 0; j < y_tap.count; j++)
+                    {
+                        const uint8_t* row = &level_texels[std::size_t(y_tap.first + j) * level.width * channels];
+                        for(uint32_t i = 0; i < x_tap.count; i++)
+                            sum += y_tap.weights[j] * x_tap.weights[i] * row[(x_tap.first + i) * channels + c];
+                    }
+                    next_texels[(std::size_t(y) * next.width + x) * channels + c] = uint8_t(std::min(sum + 0.5f, 255.0f));
+                }
+            }
+        }
+        level_texels.swap(next_texels);
+    }
+}
+
+bool Texture::read_tiled(const std::string& tiled_file, uint64_t& data_offset)
+{
+    uint64_t source_size  = 0;
+    int64_t  source_mtime = 0;
+    if(!source_info(path, source_size, source_mtime))
+        return false;
+
+    std::ifstream input(tiled_file, std::ios::binary);
+    if(!input)
+        return false;
+
+    TiledTextureHeader header = {};
+    if(!input.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       header.magic        != TILED_TEXTURE_MAGIC   ||
+       header.version      != TILED_TEXTURE_VERSION ||
+       header.channels     != channels              ||
+       header.page_size    != PAGE_SIZE             ||
+       header.source_size  != source_size           ||
+       header.source_mtime != source_mtime          ||
+       header.num_levels   == 0 || header.num_levels > 64)
+        return false;
+
+    std::vector<MipLevel> file_levels(header.num_levels);
+    if(!input.read(reinterpret_cast<char*>(file_levels.data()), file_levels.size() * sizeof(MipLevel)))
+        return false;
+
+    // The pages of the last level must all be there
+    const MipLevel& last      = file_levels.back();
+    const uint64_t  num_pages = last.first_page + uint64_t(last.pages_x) * ((last.height + PAGE_SIZE - 1) >> PAGE_SHIFT);
+    std::error_code error;
+    const uint64_t  file_size = std::filesystem::file_size(tiled_file, error);
+    if(error || header.data_offset + num_pages * page_bytes() > file_size || file_levels[0].width != header.width)
+        return false;
+
+    width       = header.width;
+    height      = header.height;
+    levels      = std::move(file_levels);
+    data_offset = header.data_offset;
+    return true;
+}
+
+bool Texture::write_tiled(const std::string& tiled_file, uint64_t& data_offset) const
+{
+    TiledTextureHeader header = {};
+    header.magic      = TILED_TEXTURE_MAGIC;
+    header.version    = TILED_TEXTURE_VERSION;
+    header.width      = width;
+    header.height     = height;
+    header.channels   = channels;
+    header.page_size  = PAGE_SIZE;
+    header.num_levels = uint32_t(levels.size());
+    if(!source_info(path, header.source_size, header.source_mtime))
+        return false;
+
+    const uint64_t table_end = sizeof(header) + levels.size() * sizeof(MipLevel);
+    header.data_offset = (table_end + TILED_TEXTURE_ALIGNMENT - 1) / TILED_TEXTURE_ALIGNMENT * TILED_TEXTURE_ALIGNMENT;
+
+    const std::string temp_path = tiled_file + ".tmp";
+    {
+        std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+        if(!output)
+            return false;
+
+        static const char padding[TILED_TEXTURE_ALIGNMENT] = {};
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(MipLevel));
+        output.write(padding, header.data_offset - table_end);
+        output.write(reinterpret_cast<const char*>(texels.data()), texels.size());
+
+        output.close();
+        if(!output)
+        {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+
+    // rename() does not replace an existing file everywhere
+    if(std::rename(temp_path.c_str(), tiled_file.c_str()) != 0)
+    {
+        std::remove(tiled_file.c_str());
+        if(std::rename(temp_path.c_str(), tiled_file.c_str()) != 0)
+        {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    data_offset = header.data_offset;
+    return true;
+}
+
+scalar Texture::level_of_detail(const scalar footprint) const
+{
+    if(!(footprint > 0))
+        return 0.0f;
+    const scalar lod = std::log2(footprint * std::sqrt(scalar(width) * scalar(height)));
+    return clamp(lod, 0.0f, scalar(levels.size() - 1));
+}
+
+template <typename PageFunction>
+void Texture::bilinear(const MipLevel& level, const Vec2& uv, scalar result[3], PageFunction&& page) const
+{
+    // Wrap into [0, 1) first so that the texel coordinates cannot overflow
+    scalar u = uv.u() - std::floor(uv.u());
+    scalar v = uv.v() - std::floor(uv.v());
+    if(!std::isfinite(u)) u = 0.0f;
+    if(!std::isfinite(v)) v = 0.0f;
+
+    // Texel centers lie at half-integer coordinates
+    const scalar fx = u * scalar(level.width)  - 0.5f;
+    const scalar fy = v * scalar(level.height) - 0.5f;
+    const scalar x_floor = std::floor(fx);
+    const scalar y_floor = std::floor(fy);
+    const scalar x_interp = fx - x_floor;
+    const scalar y_interp = fy - y_floor;
+
+    const int32_t ix = int32_t(x_floor);
+    const int32_t iy = int32_t(y_floor);
+    const uint32_t x0 = ix < 0 ? level.width  - 1 : std::min(uint32_t(ix), level.width  - 1);
+    const uint32_t y0 = iy < 0 ? level.height - 1 : std::min(uint32_t(iy), level.height - 1);
+    const uint32_t x1 = x0 + 1 == level.width  ? 0 : x0 + 1;
+    const uint32_t y1 = y0 + 1 == level.height ? 0 : y0 + 1;
+
+    // Mostly all four texels are on the same page, which is then only looked up once
+    const std::size_t p00 = page_index(level, x0, y0);
+    const std::size_t p10 = page_index(level, x1, y0);
+    const std::size_t p01 = page_index(level, x0, y1);
+    const std::size_t p11 = page_index(level, x1, y1);
+
+    const uint8_t* page00 = page(p00);
+    const uint8_t* page10 = p10 == p00 ? page00 : page(p10);
+    const uint8_t* page01 = p01 == p00 ? page00 : page(p01);
+    const uint8_t* page11 = p11 == p10 ? page10 : p11 == p01 ? page01 : page(p11);
+
+    const uint8_t* t00 = page00 + texel_in_page(x0, y0) * channels;
+    const uint8_t* t10 = page10 + texel_in_page(x1, y0) * channels;
+    const uint8_t* t01 = page01 + texel_in_page(x0, y1) * channels;
+    const uint8_t* t11 = page11 + texel_in_page(x1, y1) * channels;
+
+    const scalar w00 = (1.0f - x_interp) * (1.0f - y_interp);
+    const scalar w10 = x_interp          * (1.0f - y_interp);
+    const scalar w01 = (1.0f - x_interp) * y_interp;
+    const scalar w11 = x_interp          * y_interp;
+
+    for(uint32_t c = 0; c < channels; c++)
+        result[c] = (w00 * t00[c] + w10 * t10[c] + w01 * t01[c] + w11 * t11[c]) * DENOM;
+}
+
+template <typename PageFunction>
+void Texture::trilinear(const Vec2& uv, const scalar footprint, scalar result[3], PageFunction&& page) const
+{
+    const scalar   lod    = level_of_detail(footprint);
+    const uint32_t level  = uint32_t(lod);
+    const scalar   interp = lod - scalar(level);
+
+    bilinear(levels[level], uv, result, page);
+    if(interp == 0 || level + 1 == levels.size())
+        return;
+
+    scalar coarser[3];
+    bilinear(levels[level + 1], uv, coarser, page);
+    for(uint32_t c = 0; c < channels; c++)
+        result[c] += interp * (coarser[c] - result[c]);
+}
+
+void Texture::filter(const Vec2& uv, const scalar footprint, scalar result[3]) const
+{
+    if(cache == nullptr)
+    {
+        const std::size_t bytes = page_bytes();
+        trilinear(uv, footprint, result, [&](const std::size_t index) {
+            return &texels[index * bytes];
+        });
+        return;
+    }
+
+    // A bilinear lookup touches at most 4 pages, which must stay alive until it is done
+    TextureCache::Page held[4];
+    uint32_t           num_held = 0;
+    trilinear(uv, footprint, result, [&](const std::size_t index) {
+        TextureCache::Page& page = held[num_held++ & 3];
+        page = cache->page(file_id, index);
+        return page->data();
+    });
+}
+
+Color Texture::sample(const Vec2& uv, const scalar footprint) const
+{
+    scalar result[3];
+    filter(uv, footprint, result);
+    if(channels == 1)
+        return Color({ result[0], result[0], result[0] });
+    return Color({ result[0], result[1], result[2] });
+}
+
+scalar Texture::sample_value(const Vec2& uv, const scalar footprint) const
+{
+    scalar result[3];
+    filter(uv, footprint, result);
+    return result[0];
+}
@@ -0,0 +1,155 @@
+#ifndef GRAPHICS_TEXTURE_H
+#define GRAPHICS_TEXTURE_H
+
+#include "TextureCache.h"
+#include "../util/General.h"
+#include "../math/Vector.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#pragma pack(1)
+/**
+ * Followed by the num_levels TiledTextureLevel of the texture, and from
+ * data_offset on by the pages of every level in turn
+ **/
+struct TiledTextureHeader
+{
+    uint32_t magic;             // 'R', 'T', 'T', 'X'
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t page_size;
+    uint32_t num_levels;
+    uint32_t reserved;
+
+    // The image file the texture was loaded from
+    uint64_t source_size;
+    int64_t  source_mtime;
+
+    uint64_t data_offset;
+};
+
+struct TiledTextureLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t pages_x;
+    uint32_t reserved;
+    uint64_t first_page;
+};
+#pragma pack()
+
+/**
+ * Image texture kept as the 8-bit texels it was stored with, either all
+ * three color channels or only the first one for maps which hold a single
+ * value such as roughness or occlusion. Texels are only converted to
+ * floating point when sampled.
+ *
+ * A pyramid of mip levels, each half the size of the one before (rounded
+ * up) down to 1 x 1, is built at load. Levels are split into pages of
+ * PAGE_SIZE x PAGE_SIZE texels, which are in turn made of tiles of
+ * TILE_SIZE x TILE_SIZE, row by row within each, so that the texels
+ * around a lookup lie in one or two cache lines rather than in as many
+ * rows of the image.
+ *
+ * Given a TextureCache, the pages are written once to [path].rgb.rttex
+ * (or .r.rttex for a single channel) and from then on only read from it
+ * as they are sampled, so that only the level table stays in memory.
+ * The file is reused by later runs as long as the image is unchanged.
+ *
+ * Texture coordinates wrap around, v = 0 is the bottom row of the file
+ **/
+class Texture {
+public:
+    static constexpr uint32_t TILE_SIZE  = 8;
+    static constexpr uint32_t TILE_SHIFT = 3;
+    static constexpr uint32_t PAGE_SIZE  = 32;
+    static constexpr uint32_t PAGE_SHIFT = 5;
+
+    static std::string tiled_path(const std::string& source_path, const uint32_t channels);
+
+    /**
+     * Reads a 24 or 32-bit .BMP file, keeping 3 (RGB) or 1 (R) channels
+     * of it, and pages it through cache unless that is null. Throws if
+     * the file cannot be read
+     **/
+    Texture(const std::string& file_path, const uint32_t num_channels, TextureCache* cache = nullptr);
+
+    Texture(const Texture&)            = delete;
+    Texture& operator=(const Texture&) = delete;
+
+    /**
+     * Trilinearly filtered color at uv, for a footprint across which the
+     * lookup is spread, in texture coordinates. A footprint of 0 samples
+     * the full resolution level only, bilinearly. Single-channel textures
+     * have the same value in every channel
+     **/
+    Color  sample      (const Vec2& uv, const scalar footprint) const;
+    scalar sample_value(const Vec2& uv, const scalar footprint) const;
+
+    // Mip level, fractional, which a lookup with the given footprint reads
+    scalar level_of_detail(const scalar footprint) const;
+
+    // Bytes held by the texture itself, none if it is paged
+    inline std::size_t size_in_bytes() const { return texels.size(); }
+    inline std::size_t page_bytes()    const { return std::size_t(PAGE_SIZE) * PAGE_SIZE * channels; }
+    inline uint32_t    num_levels()    const { return uint32_t(levels.size()); }
+    inline bool        is_paged()      const { return cache != nullptr; }
+
+    std::string path;
+    uint32_t    width    = 0;
+    uint32_t    height   = 0;
+    uint32_t    channels = 0;
+private:
+    static constexpr scalar DENOM = 1.0f / 256.0f;
+
+    using MipLevel = TiledTextureLevel;
+
+    // Page of the texel at (x, y) of a level, both within its bounds
+    static inline std::size_t page_index(const MipLevel& level, const uint32_t x, const uint32_t y)
+    {
+        return level.first_page + std::size_t(y >> PAGE_SHIFT) * level.pages_x + (x >> PAGE_SHIFT);
+    }
+
+    // Index of the texel at (x, y) of a level within its page
+    static inline std::size_t texel_in_page(const uint32_t x, const uint32_t y)
+    {
+        constexpr uint32_t TILES_PER_ROW = PAGE_SIZE / TILE_SIZE;
+        const uint32_t tile = ((y & (PAGE_SIZE - 1)) >> TILE_SHIFT) * TILES_PER_ROW + ((x & (PAGE_SIZE - 1)) >> TILE_SHIFT);
+        return (std::size_t(tile) << (2 * TILE_SHIFT)) + ((y & (TILE_SIZE - 1)) << TILE_SHIFT) + (x & (TILE_SIZE - 1));
+    }
+
+    // Builds every level from the image file into texels
+    void load_image();
+
+    /**
+     * Reads the level table of the tiled file, if there is one made from
+     * the current image, or writes one from texels. Either returns false
+     * if it fails, or else the offset of the pages in the file
+     **/
+    bool read_tiled (const std::string& tiled_file, uint64_t& data_offset);
+    bool write_tiled(const std::string& tiled_file, uint64_t& data_offset) const;
+
+    /**
+     * Bilinear lookup at uv on a single level, of up to 3 channels, with
+     * page(index) returning the first byte of a page
+     **/
+    template <typename PageFunction>
+    void bilinear(const MipLevel& level, const Vec2& uv, scalar result[3], PageFunction&& page) const;
+
+    template <typename PageFunction>
+    void trilinear(const Vec2& uv, const scalar footprint, scalar result[3], PageFunction&& page) const;
+
+    void filter(const Vec2& uv, const scalar footprint, scalar result[3]) const;
+
+    std::vector<MipLevel> levels;
+    std::vector<uint8_t>  texels;     // All of the pages, unless paged through the cache
+
+    TextureCache* cache   = nullptr;
+    uint32_t      file_id = 0;
+};
+
+#endif
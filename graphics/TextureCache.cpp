@@ -0,0 +1,182 @@
+#include "TextureCache.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Pages of a file are numbered below 2^40, the file id goes above
+    constexpr uint32_t PAGE_INDEX_BITS = 40;
+
+    inline uint32_t shard_of(const uint64_t key)
+    {
+        // Neighbouring pages are looked up together, so spread them out
+        uint64_t h = key * 0x9E3779B97F4A7C15ull;
+        return uint32_t(h >> 60) % TextureCache::NUM_SHARDS;
+    }
+}
+
+TextureCache::TextureCache(const std::size_t budget_bytes):
+    budget_bytes(budget_bytes)
+{
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+TextureCache::~TextureCache()
+{
+    for(const std::unique_ptr<File>& file : files)
+        CloseHandle(file->handle);
+}
+
+uint32_t TextureCache::add_file(const std::string& path, const uint64_t data_offset, const std::size_t page_bytes)
+{
+    std::unique_ptr<File> file = std::make_unique<File>();
+    file->path        = path;
+    file->data_offset = data_offset;
+    file->page_bytes  = page_bytes;
+    file->handle      = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                    OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if(file->handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("[Error] Could not open texture file: " + path);
+
+    files.push_back(std::move(file));
+    return uint32_t(files.size() - 1);
+}
+
+// Reads bytes at offset of the file, as many threads at once as need to
+static bool read_at(void* handle, const uint64_t offset, uint8_t* dst, std::size_t bytes)
+{
+    uint64_t position = offset;
+    while(bytes > 0)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = DWORD(position);
+        overlapped.OffsetHigh = DWORD(position >> 32);
+
+        DWORD done = 0;
+        const DWORD chunk = DWORD(std::min<std::size_t>(bytes, 1u << 30));
+        if(!ReadFile(handle, dst, chunk, &done, &overlapped) || done == 0)
+            return false;
+        dst      += done;
+        bytes    -= done;
+        position += done;
+    }
+    return true;
+}
+#else
+TextureCache::~TextureCache()
+{
+    for(const std::unique_ptr<File>& file : files)
+        close(file->handle);
+}
+
+uint32_t TextureCache::add_file(const std::string& path, const uint64_t data_offset, const std::size_t page_bytes)
+{
+    std::unique_ptr<File> file = std::make_unique<File>();
+    file->path        = path;
+    file->data_offset = data_offset;
+    file->page_bytes  = page_bytes;
+    file->handle      = open(path.c_str(), O_RDONLY);
+    if(file->handle < 0)
+        throw std::runtime_error("[Error] Could not open texture file: " + path);
+
+    files.push_back(std::move(file));
+    return uint32_t(files.size() - 1);
+}
+
+// Reads bytes at offset of the file, as many threads at once as need to
+static bool read_at(const int fd, const uint64_t offset, uint8_t* dst, std::size_t bytes)
+{
+    uint64_t position = offset;
+    while(bytes > 0)
+    {
+        const ssize_t done = pread(fd, dst, bytes, off_t(position));
+        if(done <= 0)
+            return false;
+        dst      += done;
+        bytes    -= std::size_t(done);
+        position += uint64_t(done);
+    }
+    return true;
+}
+#endif
+
+TextureCache::Page TextureCache::read_page(File& file, const uint64_t page_index)
+{
+    std::shared_ptr<std::vector<uint8_t>> data = std::make_shared<std::vector<uint8_t>>(file.page_bytes);
+
+    if(!read_at(file.handle, file.data_offset + page_index * file.page_bytes, data->data(), file.page_bytes))
+    {
+        if(!file.failed.exchange(true))
+            std::cerr << "[Error] Could not read page " << page_index << " of " << file.path << '\n';
+        std::fill(data->begin(), data->end(), uint8_t(0));
+    }
+    return data;
+}
+
+TextureCache::Page TextureCache::page(const uint32_t file_id, const uint64_t page_index)
+{
+    const uint64_t key   = (uint64_t(file_id) << PAGE_INDEX_BITS) | page_index;
+    Shard&         shard = shards[shard_of(key)];
+
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        const auto found = shard.pages.find(key);
+        if(found != shard.pages.end())
+        {
+            shard.statistics.hits++;
+            shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+            return found->second->second;
+        }
+        shard.statistics.misses++;
+    }
+
+    // Another thread may read the same page meanwhile, whichever finishes
+    // second then uses the page of the first
+    File& file = *files[file_id];
+    Page  page = read_page(file, page_index);
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.statistics.bytes_read += file.page_bytes;
+
+    const auto found = shard.pages.find(key);
+    if(found != shard.pages.end())
+        return found->second->second;
+
+    shard.lru.emplace_front(key, page);
+    shard.pages[key] = shard.lru.begin();
+    shard.bytes     += page->size();
+
+    // Keep at least the page just read, however small the budget
+    const std::size_t shard_budget = budget_bytes / NUM_SHARDS;
+    while(shard.bytes > shard_budget && shard.lru.size() > 1)
+    {
+        const auto& oldest = shard.lru.back();
+        shard.bytes -= oldest.second->size();
+        shard.pages.erase(oldest.first);
+        shard.lru.pop_back();
+    }
+    return page;
+}
+
+TextureCache::Statistics TextureCache::statistics() const
+{
+    Statistics total;
+    for(const Shard& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        total.hits         += shard.statistics.hits;
+        total.misses       += shard.statistics.misses;
+        total.bytes_read   += shard.statistics.bytes_read;
+        total.bytes_cached += shard.bytes;
+    }
+    return total;
+}
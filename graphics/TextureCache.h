@@ -0,0 +1,93 @@
+#ifndef GRAPHICS_TEXTURE_CACHE_H
+#define GRAPHICS_TEXTURE_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+/**
+ * Pages of textures read on demand from their tiled files, shared by the
+ * render threads and kept within a budget of bytes by evicting the least
+ * recently used ones. It is split into shards, each with its own lock and
+ * share of the budget, so that threads looking up different pages seldom
+ * wait on one another. Files are read outside of those locks, at an
+ * offset given with each read (pread, or ReadFile with an OVERLAPPED
+ * offset), so that threads missing on the same file do not wait either.
+ *
+ * A page handed out stays valid for as long as it is referred to, even
+ * if it is evicted in the meantime
+ **/
+class TextureCache {
+public:
+    using Page = std::shared_ptr<const std::vector<uint8_t>>;
+
+    static constexpr uint32_t NUM_SHARDS = 16;
+
+    struct Statistics
+    {
+        uint64_t    hits         = 0;
+        uint64_t    misses       = 0;
+        uint64_t    bytes_read   = 0;
+        std::size_t bytes_cached = 0;
+    };
+
+    explicit TextureCache(const std::size_t budget_bytes);
+    ~TextureCache();
+
+    TextureCache(const TextureCache&)            = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /**
+     * Registers a file holding pages of page_bytes each from data_offset
+     * on, and returns the id its pages are looked up with. Files must all
+     * be added before any page is
+     **/
+    uint32_t add_file(const std::string& path, const uint64_t data_offset, const std::size_t page_bytes);
+
+    /**
+     * The page_index-th page of a file, read if it is not cached. A page
+     * which cannot be read is reported once and left zeroed
+     **/
+    Page page(const uint32_t file_id, const uint64_t page_index);
+
+    Statistics statistics() const;
+
+    inline std::size_t budget() const { return budget_bytes; }
+private:
+    using LRUList = std::list<std::pair<uint64_t, Page>>;
+
+    struct Shard
+    {
+        mutable std::mutex lock;
+        LRUList            lru;     // Most recently used first
+        std::unordered_map<uint64_t, LRUList::iterator> pages;
+        std::size_t        bytes = 0;
+        Statistics         statistics;
+    };
+
+    struct File
+    {
+        std::string       path;
+        uint64_t          data_offset;
+        std::size_t       page_bytes;
+        std::atomic<bool> failed { false };
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+        void* handle = nullptr;
+#else
+        int   handle = -1;     // File descriptor
+#endif
+    };
+
+    Page read_page(File& file, const uint64_t page_index);
+
+    std::size_t budget_bytes;
+    std::vector<std::unique_ptr<File>> files;
+    Shard shards[NUM_SHARDS];
+};
+
+#endif
@@ -16,7 +16,9 @@ bool Triangle::hit(const Ray& r,
 
     const scalar t = dot(normal, r.origin() - A) / denom;
 
-    if(t_min > t || t > t_max)
+    // Written so that degenerate (zero-area) triangles, which yield a NaN t,
+    // are rejected instead of poisoning the closest hit distance
+    if(!(t_min < t && t < t_max))
         return false;
 
     // Outside-inside test
@@ -28,9 +30,10 @@ bool Triangle::hit(const Ray& r,
     if(CAB < 0 || CCB < 0 || CAC < 0)
         return false;
 
-    // Changed from cross(B - A, C - A) because it is the same
-    const scalar area  = dot(normal, normal);
-    const scalar darea = 1.0 / area;
+    // The sub-triangle areas above are scaled by the length of the normal,
+    // which is built from unit edges, so the full area must be as well
+    const Vec3   edges = cross(B - A, C - A);
+    const scalar darea = 1.0 / dot(edges, normal);
 
     const scalar alpha = CCB * darea;
     const scalar beta  = CAC * darea;
@@ -46,13 +49,63 @@ bool Triangle::hit(const Ray& r,
         normal = -normal;
 
     rec.uv           = Vec2({ beta, gamma });
+    rec.uv_density   = 1.0f / edges.magnitude();    // Half of the unit square over the area
     rec.t            = t;
     rec.point_at_t   = r.point_at_t(rec.t);
     rec.normal       = normal;
     rec.material_ptr = material;
+    rec.primitive    = this;
     return true;
 }
 
+bool Triangle::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    // Same tests as hit(), without the barycentrics and normal
+    const Vec3 normal = cross(BA, CA);
+    const scalar denom = -dot(normal, r.direction());
+
+    if(denom < 1e-6 && !material->is_double_sided)
+        return false;
+
+    const scalar t = dot(normal, r.origin() - A) / denom;
+    if(!(t_min < t && t < t_max))
+        return false;
+
+    const Vec3 Q = r.point_at_t(t);
+    return dot(cross((B - A), (Q - A)), normal) >= 0 &&
+           dot(cross((C - B), (Q - B)), normal) >= 0 &&
+           dot(cross((A - C), (Q - C)), normal) >= 0;
+}
+
+scalar Triangle::sample_direction(const Vec3& ref_point, Vec3& wi) const
+{
+    // Uniform over the area, by folding the unit square onto the triangle
+    const Vec2   u  = random_2d();
+    const scalar su = std::sqrt(u.x());
+    const scalar s2 = u.y();
+    const Vec3 point = A + su * (1 - s2) * (B - A) + su * s2 * (C - A);
+
+    wi = point - ref_point;
+    if(wi.magnitude_squared() == 0)
+        return 0.0f;
+    wi.normalize();
+    return direction_pdf(ref_point, point);
+}
+
+scalar Triangle::direction_pdf(const Vec3& ref_point, const Vec3& point) const
+{
+    const Vec3   normal   = cross(B - A, C - A);
+    const scalar area_2   = normal.magnitude();
+    const Vec3   to_point = point - ref_point;
+    const scalar dist_sq  = to_point.magnitude_squared();
+
+    // |cos| * area, without normalizing either vector first
+    const scalar projected = 0.5f * std::fabs(dot(normal, to_point)) / std::sqrt(dist_sq);
+    if(area_2 == 0 || projected < 1e-6 * area_2)
+        return 0.0f;
+    return dist_sq / projected;
+}
+
 BoundsDefinition Triangle::get_bounds() const
 {
     Vec3 low_far = A;
@@ -6,7 +6,7 @@
 /**
  * Vertices must be specified in counterclockwise order
  **/
-class Triangle : public Primitive {
+class Triangle final : public Primitive {
 public:
     Triangle(const Vec3& v0, 
              const Vec3& v1,
@@ -21,8 +21,13 @@ public:
     { }
 
     virtual bool hit(const Ray& r, const float t_min, const float t_max, HitRecord& rec) const;
+    virtual bool occluded(const Ray& r, const float t_min, const float t_max) const;
     BoundsDefinition get_bounds() const;
 
+    virtual bool   emits_light() const { return material->emits_light(); }
+    virtual scalar sample_direction(const Vec3& ref_point, Vec3& wi) const;
+    virtual scalar direction_pdf(const Vec3& ref_point, const Vec3& point) const;
+
     // Vertex normals
     Vec3 a_nrm;
     Vec3 b_nrm;
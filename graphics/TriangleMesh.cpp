@@ -0,0 +1,435 @@
+#include "TriangleMesh.h"
+
+#include <cfloat>
+#include <algorithm>
+
+namespace
+{
+    // Determinants closer to zero mean the ray is (almost) parallel to the triangle
+    constexpr float DET_EPSILON = 1e-9f;
+}
+
+void TriangleMesh::reserve(std::size_t n_vertices, std::size_t n_normals, std::size_t n_triangles)
+{
+    vertices.reserve(n_vertices);
+    normals.reserve(n_normals);
+    indices.reserve(3 * n_triangles);
+    normal_indices.reserve(3 * n_triangles);
+}
+
+void TriangleMesh::add_triangle(uint32_t a, uint32_t b, uint32_t c)
+{
+    indices.push_back(a);
+    indices.push_back(b);
+    indices.push_back(c);
+}
+
+void TriangleMesh::add_triangle(uint32_t a,   uint32_t b,   uint32_t c,
+                                uint32_t n_a, uint32_t n_b, uint32_t n_c)
+{
+    add_triangle(a, b, c);
+    normal_indices.push_back(n_a);
+    normal_indices.push_back(n_b);
+    normal_indices.push_back(n_c);
+}
+
+void TriangleMesh::build()
+{
+    const uint32_t n_triangles = num_triangles();
+
+    std::vector<AABB> tri_bounds(n_triangles);
+    for(uint32_t i = 0; i < n_triangles; i++)
+    {
+        tri_bounds[i].grow(vertices[indices[3 * i + 0]]);
+        tri_bounds[i].grow(vertices[indices[3 * i + 1]]);
+        tri_bounds[i].grow(vertices[indices[3 * i + 2]]);
+    }
+
+    // Leaves as wide as the kernel, so that one leaf is usually one block
+    bvh.build(tri_bounds, TriangleBlock::WIDTH);
+
+    blocks.clear();
+    blocks.reserve(n_triangles / TriangleBlock::WIDTH + bvh.nodes.size());
+
+    for(BVHNode& node : bvh.nodes)
+    {
+        if(!node.is_leaf())
+            continue;
+
+        const uint32_t first_block = blocks.size();
+        for(uint32_t i = 0; i < node.prim_count; i += TriangleBlock::WIDTH)
+        {
+            TriangleBlock block = {};
+            for(uint32_t lane = 0; lane < TriangleBlock::WIDTH; lane++)
+            {
+                if(i + lane >= node.prim_count)
+                    break;
+
+                const uint32_t tri = bvh.prim_indices[node.left_first + i + lane];
+                const Vec3 A  = vertices[indices[3 * tri + 0]];
+                const Vec3 e1 = vertices[indices[3 * tri + 1]] - A;
+                const Vec3 e2 = vertices[indices[3 * tri + 2]] - A;
+
+                block.v0_x[lane] = A.x();  block.v0_y[lane] = A.y();  block.v0_z[lane] = A.z();
+                block.e1_x[lane] = e1.x(); block.e1_y[lane] = e1.y(); block.e1_z[lane] = e1.z();
+                block.e2_x[lane] = e2.x(); block.e2_y[lane] = e2.y(); block.e2_z[lane] = e2.z();
+                block.triangle[lane] = tri;
+            }
+            blocks.push_back(block);
+        }
+
+        // From here on leaves refer to blocks rather than to prim_indices
+        node.left_first = first_block;
+        node.prim_count = blocks.size() - first_block;
+    }
+}
+
+#if defined(TRIANGLE_MESH_AVX2)
+
+bool TriangleMesh::intersect_block(const TriangleBlock& block,
+                                   const Ray&   r,
+                                   const scalar t_min,
+                                   scalar&      closest,
+                                   uint32_t&    triangle,
+                                   scalar&      u,
+                                   scalar&      v) const
+{
+    // Moller-Trumbore on all eight lanes at once
+    const __m256 dx = _mm256_set1_ps(r.dir.x());
+    const __m256 dy = _mm256_set1_ps(r.dir.y());
+    const __m256 dz = _mm256_set1_ps(r.dir.z());
+
+    const __m256 e1x = _mm256_loadu_ps(block.e1_x);
+    const __m256 e1y = _mm256_loadu_ps(block.e1_y);
+    const __m256 e1z = _mm256_loadu_ps(block.e1_z);
+    const __m256 e2x = _mm256_loadu_ps(block.e2_x);
+    const __m256 e2y = _mm256_loadu_ps(block.e2_y);
+    const __m256 e2z = _mm256_loadu_ps(block.e2_z);
+
+    // P = D x E2, det = E1 . P
+    const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)),
+                                     _mm256_mul_ps(e1z, pz));
+
+    // Back faces have a negative determinant
+    __m256 mask;
+    if(material->is_double_sided)
+    {
+        const __m256 abs_det = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+        mask = _mm256_cmp_ps(abs_det, _mm256_set1_ps(DET_EPSILON), _CMP_GT_OQ);
+    } else
+        mask = _mm256_cmp_ps(det, _mm256_set1_ps(DET_EPSILON), _CMP_GT_OQ);
+
+    if(_mm256_movemask_ps(mask) == 0)
+        return false;
+
+    const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+    // T = O - V0, u = (T . P) / det
+    const __m256 tx = _mm256_sub_ps(_mm256_set1_ps(r.orig.x()), _mm256_loadu_ps(block.v0_x));
+    const __m256 ty = _mm256_sub_ps(_mm256_set1_ps(r.orig.y()), _mm256_loadu_ps(block.v0_y));
+    const __m256 tz = _mm256_sub_ps(_mm256_set1_ps(r.orig.z()), _mm256_loadu_ps(block.v0_z));
+    const __m256 lu = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)),
+                                                  _mm256_mul_ps(tz, pz)), inv_det);
+
+    // Q = T x E1, v = (D . Q) / det, t = (E2 . Q) / det
+    const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+    const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+    const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+    const __m256 lv = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+                                                  _mm256_mul_ps(dz, qz)), inv_det);
+    const __m256 lt = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+                                                  _mm256_mul_ps(e2z, qz)), inv_det);
+
+    const __m256 zero = _mm256_setzero_ps();
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(lu, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(lv, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(lu, lv), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(lt, _mm256_set1_ps(t_min),   _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(lt, _mm256_set1_ps(closest), _CMP_LT_OQ));
+
+    int hits = _mm256_movemask_ps(mask);
+    if(hits == 0)
+        return false;
+
+    alignas(32) float t_lanes[8], u_lanes[8], v_lanes[8];
+    _mm256_store_ps(t_lanes, lt);
+    _mm256_store_ps(u_lanes, lu);
+    _mm256_store_ps(v_lanes, lv);
+
+    for(uint32_t lane = 0; hits != 0; lane++, hits >>= 1)
+    {
+        if((hits & 1) && t_lanes[lane] < closest)
+        {
+            closest  = t_lanes[lane];
+            u        = u_lanes[lane];
+            v        = v_lanes[lane];
+            triangle = block.triangle[lane];
+        }
+    }
+    return true;
+}
+
+#elif defined(TRIANGLE_MESH_SSE)
+
+bool TriangleMesh::intersect_block(const TriangleBlock& block,
+                                   const Ray&   r,
+                                   const scalar t_min,
+                                   scalar&      closest,
+                                   uint32_t&    triangle,
+                                   scalar&      u,
+                                   scalar&      v) const
+{
+    // Moller-Trumbore on all four lanes at once
+    const __m128 dx = _mm_set1_ps(r.dir.x());
+    const __m128 dy = _mm_set1_ps(r.dir.y());
+    const __m128 dz = _mm_set1_ps(r.dir.z());
+
+    const __m128 e1x = _mm_loadu_ps(block.e1_x);
+    const __m128 e1y = _mm_loadu_ps(block.e1_y);
+    const __m128 e1z = _mm_loadu_ps(block.e1_z);
+    const __m128 e2x = _mm_loadu_ps(block.e2_x);
+    const __m128 e2y = _mm_loadu_ps(block.e2_y);
+    const __m128 e2z = _mm_loadu_ps(block.e2_z);
+
+    // P = D x E2, det = E1 . P
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+                                  _mm_mul_ps(e1z, pz));
+
+    // Back faces have a negative determinant
+    __m128 mask;
+    if(material->is_double_sided)
+    {
+        const __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+        mask = _mm_cmpgt_ps(abs_det, _mm_set1_ps(DET_EPSILON));
+    } else
+        mask = _mm_cmpgt_ps(det, _mm_set1_ps(DET_EPSILON));
+
+    if(_mm_movemask_ps(mask) == 0)
+        return false;
+
+    const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    // T = O - V0, u = (T . P) / det
+    const __m128 tx = _mm_sub_ps(_mm_set1_ps(r.orig.x()), _mm_loadu_ps(block.v0_x));
+    const __m128 ty = _mm_sub_ps(_mm_set1_ps(r.orig.y()), _mm_loadu_ps(block.v0_y));
+    const __m128 tz = _mm_sub_ps(_mm_set1_ps(r.orig.z()), _mm_loadu_ps(block.v0_z));
+    const __m128 lu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)),
+                                            _mm_mul_ps(tz, pz)), inv_det);
+
+    // Q = T x E1, v = (D . Q) / det, t = (E2 . Q) / det
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    const __m128 lv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                                            _mm_mul_ps(dz, qz)), inv_det);
+    const __m128 lt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                                            _mm_mul_ps(e2z, qz)), inv_det);
+
+    const __m128 zero = _mm_setzero_ps();
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(lu, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(lv, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(lu, lv), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(lt, _mm_set1_ps(t_min)));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(lt, _mm_set1_ps(closest)));
+
+    int hits = _mm_movemask_ps(mask);
+    if(hits == 0)
+        return false;
+
+    alignas(16) float t_lanes[4], u_lanes[4], v_lanes[4];
+    _mm_store_ps(t_lanes, lt);
+    _mm_store_ps(u_lanes, lu);
+    _mm_store_ps(v_lanes, lv);
+
+    for(uint32_t lane = 0; hits != 0; lane++, hits >>= 1)
+    {
+        if((hits & 1) && t_lanes[lane] < closest)
+        {
+            closest  = t_lanes[lane];
+            u        = u_lanes[lane];
+            v        = v_lanes[lane];
+            triangle = block.triangle[lane];
+        }
+    }
+    return true;
+}
+
+#else
+
+bool TriangleMesh::intersect_block(const TriangleBlock& block,
+                                   const Ray&   r,
+                                   const scalar t_min,
+                                   scalar&      closest,
+                                   uint32_t&    triangle,
+                                   scalar&      u,
+                                   scalar&      v) const
+{
+    bool hit_anything = false;
+
+    for(uint32_t lane = 0; lane < TriangleBlock::WIDTH; lane++)
+    {
+        const Vec3 e1 = Vec3({ block.e1_x[lane], block.e1_y[lane], block.e1_z[lane] });
+        const Vec3 e2 = Vec3({ block.e2_x[lane], block.e2_y[lane], block.e2_z[lane] });
+
+        const Vec3   P   = cross(r.dir, e2);
+        const scalar det = dot(e1, P);
+
+        // Back faces have a negative determinant
+        if(material->is_double_sided ? !(std::fabs(det) > DET_EPSILON) : !(det > DET_EPSILON))
+            continue;
+
+        const scalar inv_det = 1.0f / det;
+        const Vec3   T  = r.orig - Vec3({ block.v0_x[lane], block.v0_y[lane], block.v0_z[lane] });
+        const scalar lu = dot(T, P) * inv_det;
+        if(lu < 0.0f || lu > 1.0f)
+            continue;
+
+        const Vec3   Q  = cross(T, e1);
+        const scalar lv = dot(r.dir, Q) * inv_det;
+        if(lv < 0.0f || lu + lv > 1.0f)
+            continue;
+
+        const scalar lt = dot(e2, Q) * inv_det;
+        if(t_min < lt && lt < closest)
+        {
+            closest  = lt;
+            u        = lu;
+            v        = lv;
+            triangle = block.triangle[lane];
+            hit_anything = true;
+        }
+    }
+    return hit_anything;
+}
+
+#endif
+
+bool TriangleMesh::hit(const Ray& r, const scalar t_min, const scalar t_max, HitRecord& rec) const
+{
+    scalar   closest  = t_max;
+    uint32_t triangle = 0;
+    scalar   u = 0.0f, v = 0.0f;
+
+    bool hit_anything = bvh.traverse(r, t_min, closest, [&](const BVHNode& leaf, scalar& nearest) {
+        bool hit_leaf = false;
+        for(uint32_t i = 0; i < leaf.prim_count; i++)
+        {
+            if(intersect_block(blocks[leaf.left_first + i], r, t_min, nearest, triangle, u, v))
+                hit_leaf = true;
+        }
+        return hit_leaf;
+    });
+
+    if(!hit_anything)
+        return false;
+
+    // Shade only the triangle that was actually hit
+    shade(r, triangle, u, v, closest, rec);
+    return true;
+}
+
+void TriangleMesh::hit_packet(RayPacket&      packet,
+                              const uint32_t* active,
+                              const uint32_t  num_active,
+                              const scalar    t_min,
+                              HitRecord*      recs) const
+{
+    if(num_active == 0)
+        return;
+
+    // Nearest triangle of each ray, shaded once the traversal is over
+    uint32_t triangle[RayPacket::MAX_SIZE];
+    scalar   u[RayPacket::MAX_SIZE];
+    scalar   v[RayPacket::MAX_SIZE];
+    bool     found[RayPacket::MAX_SIZE] = {};
+
+    bvh.traverse_packet(packet, t_min, active[0],
+        [&](const BVHNode& leaf, const uint32_t* leaf_active, const uint32_t leaf_num_active) {
+            for(uint32_t k = 0; k < leaf_num_active; k++)
+            {
+                const uint32_t j = leaf_active[k];
+                const Ray      r = packet.ray(j);
+                for(uint32_t i = 0; i < leaf.prim_count; i++)
+                {
+                    if(intersect_block(blocks[leaf.left_first + i], r, t_min, packet.t_max[j], triangle[j], u[j], v[j]))
+                        found[j] = true;
+                }
+            }
+        });
+
+    for(uint32_t j = active[0]; j < packet.count; j++)
+    {
+        if(found[j])
+            shade(packet.ray(j), triangle[j], u[j], v[j], packet.t_max[j], recs[j]);
+    }
+}
+
+void TriangleMesh::shade(const Ray& r, const uint32_t triangle, const scalar u, const scalar v, const scalar t, HitRecord& rec) const
+{
+    const Vec3 A = vertices[indices[3 * triangle + 0]];
+    const Vec3 B = vertices[indices[3 * triangle + 1]];
+    const Vec3 C = vertices[indices[3 * triangle + 2]];
+
+    Vec3 normal = cross(normalize(B - A), normalize(C - A));
+    const scalar denom = -dot(normal, r.direction());
+
+    // Weights of A, B and C are (1 - u - v), u and v respectively
+    if(normal_indices.size() == indices.size())
+    {
+        normal = normals[normal_indices[3 * triangle + 0]] * (1.0f - u - v) +
+                 normals[normal_indices[3 * triangle + 1]] * u +
+                 normals[normal_indices[3 * triangle + 2]] * v;
+    }
+
+    if(denom < 0 && material->is_double_sided)
+        normal = -normal;
+
+    // Twice the area of the triangle in texture space, that of the
+    // barycentrics being half of the unit square
+    Vec2   uv      = Vec2({ u, v });
+    scalar uv_area = 1.0f;
+    if(texcoord_indices.size() == indices.size())
+    {
+        const Vec2 uv_a = texcoords[texcoord_indices[3 * triangle + 0]];
+        const Vec2 uv_b = texcoords[texcoord_indices[3 * triangle + 1]];
+        const Vec2 uv_c = texcoords[texcoord_indices[3 * triangle + 2]];
+        uv      = uv_a * (1.0f - u - v) + uv_b * u + uv_c * v;
+        uv_area = std::fabs((uv_b.u() - uv_a.u()) * (uv_c.v() - uv_a.v()) - 
+                            (uv_c.u() - uv_a.u()) * (uv_b.v() - uv_a.v()));
+    }
+
+    rec.uv           = uv;
+    rec.uv_density   = uv_area / cross(B - A, C - A).magnitude();
+    rec.t            = t;
+    rec.point_at_t   = r.point_at_t(rec.t);
+    rec.normal       = normal;
+    rec.material_ptr = material;
+    rec.primitive    = this;
+}
+
+bool TriangleMesh::occluded(const Ray& r, const scalar t_min, const scalar t_max) const
+{
+    return bvh.traverse_any(r, t_min, t_max, [&](const BVHNode& leaf) {
+        for(uint32_t i = 0; i < leaf.prim_count; i++)
+        {
+            scalar   closest = t_max;
+            uint32_t triangle;
+            scalar   u, v;
+            if(intersect_block(blocks[leaf.left_first + i], r, t_min, closest, triangle, u, v))
+                return true;
+        }
+        return false;
+    });
+}
+
+BoundsDefinition TriangleMesh::get_bounds() const
+{
+    const AABB bounds = bvh.bounds();
+    return BoundsDefinition { bounds.lower, bounds.upper };
+}
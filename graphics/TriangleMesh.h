@@ -0,0 +1,108 @@
+#ifndef GRAPHICS_TRIANGLE_MESH_H
+#define GRAPHICS_TRIANGLE_MESH_H
+
+#include "Primitive.h"
+#include "BVH.h"
+
+#include <vector>
+#include <cstdint>
+
+// Define RAYTRACER_NO_SIMD to force the scalar intersection kernel
+#if !defined(RAYTRACER_NO_SIMD) && defined(__AVX2__)
+#define TRIANGLE_MESH_AVX2
+#include <immintrin.h>
+#elif !defined(RAYTRACER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TRIANGLE_MESH_SSE
+#include <emmintrin.h>
+#endif
+
+/**
+ * Triangles packed for the intersection kernel, one lane per triangle.
+ * Unused lanes hold degenerate triangles which can never be hit
+ **/
+struct TriangleBlock
+{
+#if defined(TRIANGLE_MESH_AVX2)
+    static constexpr uint32_t WIDTH = 8;
+#else
+    static constexpr uint32_t WIDTH = 4;
+#endif
+    float v0_x[WIDTH], v0_y[WIDTH], v0_z[WIDTH];
+    float e1_x[WIDTH], e1_y[WIDTH], e1_z[WIDTH];   // v1 - v0
+    float e2_x[WIDTH], e2_y[WIDTH], e2_z[WIDTH];   // v2 - v0
+    uint32_t triangle[WIDTH];
+};
+
+/**
+ * Triangle soup sharing a single material, stored as flat vertex, normal
+ * and index arrays rather than as individual Triangle objects. It has its
+ * own BVH, whose leaves are tested a whole TriangleBlock at a time, and
+ * only the nearest triangle is shaded at the end.
+ *
+ * Vertices must be specified in counterclockwise order
+ **/
+class TriangleMesh : public Primitive {
+public:
+    TriangleMesh(Material* material):
+        material(material)
+    {
+    }
+
+    void reserve(std::size_t n_vertices, std::size_t n_normals, std::size_t n_triangles);
+
+    /**
+     * Vertex normals are only interpolated if every triangle was added
+     * along with normal indices, otherwise the face normal is used.
+     * Likewise for texture coordinates, which otherwise are the
+     * barycentric coordinates of the hit
+     **/
+    void add_triangle(uint32_t a, uint32_t b, uint32_t c);
+    void add_triangle(uint32_t a,   uint32_t b,   uint32_t c,
+                      uint32_t n_a, uint32_t n_b, uint32_t n_c);
+
+    /**
+     * Builds the BVH and packs the triangles of its leaves into blocks,
+     * must be called once all of the triangles have been added
+     **/
+    void build();
+
+    virtual bool hit(const Ray& r, const float t_min, const float t_max, HitRecord& rec) const;
+    virtual bool occluded(const Ray& r, const float t_min, const float t_max) const;
+    virtual void hit_packet(RayPacket& packet, const uint32_t* active, const uint32_t num_active,
+                            const float t_min, HitRecord* recs) const;
+    BoundsDefinition get_bounds() const;
+
+    inline std::size_t num_triangles() const { return indices.size() / 3; }
+
+    std::vector<Vec3>     vertices;
+    std::vector<Vec3>     normals;
+    std::vector<Vec2>     texcoords;
+    std::vector<uint32_t> indices;            // 3 vertex indices per triangle
+    std::vector<uint32_t> normal_indices;     // 3 normal indices per triangle
+    std::vector<uint32_t> texcoord_indices;   // 3 texture coordinate indices per triangle
+    Material* material = nullptr;
+private:
+    /**
+     * Tests every lane of the block, and if any is nearer than closest
+     * updates closest along with the triangle and barycentrics of the hit
+     **/
+    bool intersect_block(const TriangleBlock& block,
+                         const Ray&   r,
+                         const scalar t_min,
+                         scalar&      closest,
+                         uint32_t&    triangle,
+                         scalar&      u,
+                         scalar&      v) const;
+
+    // Fills in rec for the hit at t on the given triangle
+    void shade(const Ray& r, const uint32_t triangle, const scalar u, const scalar v, const scalar t, HitRecord& rec) const;
+
+    // Saved and restored as they are, built
+    friend class MeshCache;
+
+    // Leaves of the BVH refer to prim_count blocks starting at left_first
+    BVH bvh;
+    std::vector<TriangleBlock> blocks;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "Wavefront.h"
+#include "Integrator.h"
+
+#include <algorithm>
+#include <functional>
+
+void Wavefront::resize(const uint32_t num_paths)
+{
+    rays          .resize(num_paths);
+    recs          .resize(num_paths);
+    hits          .resize(num_paths);
+    samples       .resize(num_paths);
+    path_radiance .resize(num_paths);
+    throughput    .resize(num_paths);
+    scatter_pdf   .resize(num_paths);
+    scatter_origin.resize(num_paths);
+    cone_width    .resize(num_paths);
+    attenuation   .resize(num_paths);
+    scattered     .resize(num_paths);
+    scatters      .resize(num_paths);
+}
+
+void Wavefront::start_path(const uint32_t              i,
+                           const Ray&                  r,
+                           const bool                  hit,
+                           const HitRecord&            rec,
+                           const Sampler::SampleState& sample)
+{
+    rays[i]          = r;
+    recs[i]          = rec;
+    hits[i]          = hit;
+    samples[i]       = sample;
+    path_radiance[i] = Color({ 0.0, 0.0, 0.0 });
+    throughput[i]    = Color({ 1.0, 1.0, 1.0 });
+    scatter_pdf[i]   = 0.0f;
+    cone_width[i]    = 0.0f;
+}
+
+void Wavefront::run(const Scene& world)
+{
+    active.resize(rays.size());
+    for(uint32_t i = 0; i < active.size(); i++)
+        active[i] = i;
+
+    // Camera rays were intersected by the caller
+    for(uint32_t depth = 0; !active.empty(); depth++)
+    {
+        if(depth > 0)
+            intersect(world);
+        gather_emission(world, depth);
+        shade();
+        connect_and_extend(world, depth);
+    }
+}
+
+void Wavefront::intersect(const Scene& world)
+{
+    // Back in pixel order, neighbouring rays being the likeliest to take
+    // the same way through the hierarchies
+    std::sort(active.begin(), active.end());
+    for(const uint32_t i : active)
+    {
+        recs[i] = HitRecord {};
+        hits[i] = world.anything_hit(rays[i], 1e-3, FLT_MAX, recs[i]);
+    }
+}
+
+void Wavefront::gather_emission(const Scene& world, const uint32_t depth)
+{
+    // Ray cone of the pixel, see color()
+    const scalar cone_spread = world.pixel_spread_angle();
+
+    uint32_t num_active = 0;
+    for(const uint32_t i : active)
+    {
+        if(!hits[i])
+        {
+            path_radiance[i] += throughput[i] * background(rays[i]);
+            continue;
+        }
+        if(depth > world.max_recursion_depth)
+            continue;
+
+        HitRecord& rec = recs[i];
+        cone_width[i] += cone_spread * rec.t * rays[i].direction().magnitude();
+        rec.cone_width = cone_width[i];
+
+        Color emitted = rec.material_ptr->emitted(rec.uv);
+        if(scatter_pdf[i] > 0 && world.sample_lights)
+            emitted *= power_heuristic(scatter_pdf[i], world.light_pdf(scatter_origin[i], rec));
+        path_radiance[i] += throughput[i] * emitted;
+
+        active[num_active++] = i;
+    }
+    active.resize(num_active);
+}
+
+void Wavefront::shade()
+{
+    // Paths on the same material end up next to one another, in order
+    std::sort(active.begin(), active.end(), [this](const uint32_t a, const uint32_t b) {
+        const Material* material_a = recs[a].material_ptr;
+        const Material* material_b = recs[b].material_ptr;
+        return material_a != material_b ? std::less<const Material*>()(material_a, material_b) : a < b;
+    });
+
+    for(uint32_t begin = 0; begin < active.size(); )
+    {
+        const Material* material = recs[active[begin]].material_ptr;
+        uint32_t end = begin + 1;
+        while(end < active.size() && recs[active[end]].material_ptr == material)
+            end++;
+
+        const ScatterBatch batch = {
+            &active[begin], end - begin,
+            rays.data(), recs.data(), samples.data(),
+            attenuation.data(), scattered.data(), scatters.data()
+        };
+        material->scatter_batch(batch);
+        begin = end;
+    }
+}
+
+void Wavefront::connect_and_extend(const Scene& world, const uint32_t depth)
+{
+    Sampler& sampler = Sampler::current();
+
+    uint32_t num_active = 0;
+    for(const uint32_t i : active)
+    {
+        if(!scatters[i])
+            continue;
+
+        const HitRecord& rec = recs[i];
+        sampler.resume_sample(samples[i]);
+        if(world.sample_lights && rec.material_ptr->is_light_sampled())
+            path_radiance[i] += throughput[i] * direct_light(rec, world);
+
+        scatter_origin[i] = rec.point_at_t;
+        scatter_pdf[i]    = rec.material_ptr->pdf(rec, normalize(scattered[i].direction()));
+        throughput[i]     = throughput[i] * attenuation[i];
+
+        const bool survives = survives_roulette(depth, world, throughput[i]);
+        samples[i] = sampler.suspend_sample();
+        if(!survives)
+            continue;
+
+        rays[i] = scattered[i];
+        active[num_active++] = i;
+    }
+    active.resize(num_active);
+}
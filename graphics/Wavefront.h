@@ -0,0 +1,80 @@
+#ifndef GRAPHICS_WAVEFRONT_H
+#define GRAPHICS_WAVEFRONT_H
+
+#include "Scene.h"
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * Traces many paths together, such as one sample of every pixel of a tile,
+ * in stages rather than one path after the other. At each bounce all of the
+ * paths still going are intersected, then sorted by the material they hit,
+ * so that each material scatters its hits as one batch (see
+ * Material::scatter_batch()), then connected to the lights and extended.
+ *
+ * State is kept one array per quantity, indexed by path. Each path draws
+ * from its own sample of the Sampler, set aside between stages, so it gives
+ * exactly what color() would have for it
+ **/
+class Wavefront {
+public:
+    // Makes room for num_paths paths, all of which are then started
+    void resize(const uint32_t num_paths);
+
+    /**
+     * Starts path i along the camera ray r, whose hit, if any, was already
+     * found, with the sample it was started in, which the caller set aside
+     **/
+    void start_path(const uint32_t              i,
+                    const Ray&                  r,
+                    const bool                  hit,
+                    const HitRecord&            rec,
+                    const Sampler::SampleState& sample);
+
+    // Traces every path until it ends
+    void run(const Scene& world);
+
+    // Radiance found by path i, once run
+    inline const Color& radiance(const uint32_t i) const { return path_radiance[i]; }
+
+private:
+    // Closest hits of the active paths past their first bounce
+    void intersect(const Scene& world);
+
+    /**
+     * Adds what the active paths hit emits, or the sky for those which
+     * missed, and keeps the paths which go on to scatter
+     **/
+    void gather_emission(const Scene& world, const uint32_t depth);
+
+    // Orders the active paths by material and has each material scatter its own
+    void shade();
+
+    /**
+     * Next event estimation, throughput and Russian roulette for the
+     * active paths, keeping those which carry on along their scattered ray
+     **/
+    void connect_and_extend(const Scene& world, const uint32_t depth);
+
+    std::vector<Ray>                  rays;
+    std::vector<HitRecord>            recs;
+    std::vector<uint8_t>              hits;
+    std::vector<Sampler::SampleState> samples;
+
+    std::vector<Color>  path_radiance;
+    std::vector<Color>  throughput;
+    std::vector<scalar> scatter_pdf;
+    std::vector<Vec3>   scatter_origin;
+    std::vector<scalar> cone_width;
+
+    // Output of shade()
+    std::vector<Color>   attenuation;
+    std::vector<Ray>     scattered;
+    std::vector<uint8_t> scatters;
+
+    // Paths still going
+    std::vector<uint32_t> active;
+};
+
+#endif
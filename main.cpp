@@ -12,13 +12,19 @@
 #include <cassert>
 #include <sstream>
 #include <memory>
+#include <algorithm>
 
+// Define RAYTRACER_NO_GUI to build without SFML, rendering is then always headless
+#ifndef RAYTRACER_NO_GUI
 #include <SFML/Graphics.hpp>
+#endif
 
 #include "math/Vector.h"
 
 #include "util/BitmapImage.h"
 #include "util/Threading.h"
+#include "util/Checkpoint.h"
+#include "util/Distributed.h"
 #include "util/General.h"
 
 #include "math/Ray.h"
@@ -30,99 +36,189 @@
 #include "graphics/Rectangle3D.h"
 #include "graphics/Plane.h"
 #include "graphics/Scene.h"
+#include "graphics/Integrator.h"
 
-Color color(const Ray& r, const Scene& world, uint32_t depth)
+using RenderClock = std::chrono::high_resolution_clock;
+
+void print_render_time(const RenderClock::time_point& time_render_begin)
 {
-    HitRecord rec = {};
-    if(world.anything_hit(r, 1e-3, FLT_MAX, rec))
-    {
-        Ray   scattered;
-        Color attenuation;
-        
-        if(depth > world.max_recursion_depth)
-           return Color({ 0.0, 0.0, 0.0 }); 
-        
-        Vec3 emitted = rec.material_ptr->emitted(rec.uv);
-
-        if(rec.material_ptr->scatter(r, rec, attenuation, scattered))
-            return emitted + attenuation * color(scattered, world, depth + 1);
-
-        return emitted;
-    }
-    // Comment for ambient background
-    Vector unit_dir = normalize(r.direction());
-    float t = 0.5 * (unit_dir.y() + 1.0f);
-    return (1.0 - t) * Vec3({1.0, 1.0, 1.0}) + t * Vec3({0.5, 0.7, 1.0});
-    //return world.ambient;
+    auto time_render_end   = RenderClock::now();
+    auto time_render_total = std::chrono::duration<scalar>(time_render_end - time_render_begin).count();
+    std::cout << "The render took " << std::fixed << std::setprecision(2)
+              << time_render_total  << " seconds.\n";
 }
 
-int thread_render_image_tiles(RenderThreadControl* tcb)
+#ifndef RAYTRACER_NO_GUI
+/**
+ * Shows the image as its tiles are rendered, until the window is closed
+ **/
+void run_display(RenderThreadControl& thread_control, const RenderClock::time_point& time_render_begin)
 {
-    ImageRenderInfo* image = (ImageRenderInfo*)&tcb->image;
+    const uint32_t IMAGE_WIDTH  = thread_control.image.image_width;
+    const uint32_t IMAGE_HEIGHT = thread_control.image.image_height;
 
-    bool continue_to_work = true;
-    while(continue_to_work)
+    sf::RenderWindow window(sf::VideoMode(IMAGE_WIDTH, IMAGE_HEIGHT), "Render");
+    sf::Image output;
+    output.create(IMAGE_WIDTH, IMAGE_HEIGHT, sf::Color::Black);
+
+    bool output_done = false;    
+    while(window.isOpen())
     {
-        SectionRenderInfo* current_section = NULL;
+        sf::Event event;
+        while(window.pollEvent(event))
+        {
+            if(event.type == sf::Event::Closed)
+                window.close();
+        }
 
-        // Check if queue is not empty,
-        lock_mutex(tcb);
-        if(image->section_queue_front != image->sections.size())
-            current_section = &image->sections[image->section_queue_front++];
-        else
-            continue_to_work = false;
-        unlock_mutex(tcb);
+        // Draw
+        window.clear(sf::Color::Black);
 
-        // color the current section of the image
-        if(current_section != NULL && continue_to_work)
+        // Each tile is copied under its own lock, which its render thread
+        // only takes briefly once per sample pass
+        for(SectionRenderInfo& section : thread_control.image.sections)
         {
-            const uint32_t bounds_x = current_section->tile_x + current_section->tile_width;
-            const uint32_t bounds_y = current_section->tile_y + current_section->tile_height;
-            const scalar   NS_DENOM = 1 / scalar(image->num_samples);
-            const scalar   IW_DENOM = 1 / scalar(image->image_width);
-            const scalar   IH_DENOM = 1 / scalar(image->image_height);
-
-            current_section->in_progress = true;
-            for(uint32_t y = current_section->tile_y; y < bounds_y; y++ )
+            std::lock_guard<std::mutex> guard(section.lock);
+            for(uint32_t y = section.tile_y; y < section.tile_y + section.tile_height; y++)
             {
-                for(uint32_t x = current_section->tile_x; x < bounds_x; x++ )
+                for(uint32_t x = section.tile_x; x < section.tile_x + section.tile_width; x++)
                 {
-                    Vec3 pixel = {};
-                    scalar u = scalar(x + random_scalar()) * IW_DENOM;
-                    scalar v = scalar(y + random_scalar()) * IH_DENOM;
-
-                    Ray r  = image->camera->get_ray(u, v);
-                    pixel += color(r, *image->world, 0);
-                    pixel *= NS_DENOM;
-                    image->pixels[y * image->image_width + x] += pixel; 
+                    const Vec3* pixel = &thread_control.image.pixels[y * IMAGE_WIDTH + x];
+                    output.setPixel(x, IMAGE_HEIGHT - 1 - y, 
+                                    sf::Color(255.99 * sqrt(clamp(pixel->x(), 0.0f, 1.0f)), 
+                                              255.99 * sqrt(clamp(pixel->y(), 0.0f, 1.0f)), 
+                                              255.99 * sqrt(clamp(pixel->z(), 0.0f, 1.0f))));
                 }
             }
-            current_section->is_finished = true;
-            current_section->in_progress = false;
-            current_section = NULL;
-        } else
-            break;
+        }
+
+        sf::Texture tex;
+        tex.loadFromImage(output);
+        sf::Sprite sprite;
+        sprite.setTexture(tex);
+        window.draw(sprite);
+
+        for(const SectionRenderInfo& section : thread_control.image.sections)
+        {
+            if(section.in_progress)
+            {
+                sf::RectangleShape rect(sf::Vector2f( (uint32_t) section.tile_width, 
+                                                      (uint32_t) section.tile_height ));
+                rect.setFillColor(sf::Color(0, 0, 0, 0.0));
+                rect.setPosition (section.tile_x , IMAGE_HEIGHT - section.tile_y - section.tile_height);
+                rect.setOutlineThickness(1.0);
+                rect.setOutlineColor(sf::Color(255.0, 255.0, 255.0));
+
+                window.draw(rect);
+            }
+        }
 
+        if(thread_control.image.is_finished() && !output_done)
+        {
+            print_render_time(time_render_begin);
+            output_done = true;
+        }
+
+        window.display();
+    }
+}
+#endif
+
+/**
+ * Stands in for the display on machines without one, reporting progress
+ * now and then until the last tile is done
+ **/
+void wait_headless(const RenderThreadControl& thread_control)
+{
+    const ImageRenderInfo& image = thread_control.image;
+
+    uint32_t last_reported = 0;
+    while(!image.is_finished())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+        const uint32_t finished = image.finished_sections.load();
+        if(finished != last_reported)
+        {
+            std::printf("[INFO ] %u / %u tiles done\n", finished, uint32_t(image.sections.size()));
+            std::fflush(stdout);
+            last_reported = finished;
+        }
     }
-    return 0;
 }
 
 int main(int argc, char** argv)
 {
-    if(argc < 2)
+    const char* description_file = nullptr;
+    bool   headless    = false;
+    bool   resume      = false;
+    scalar time_budget = -1.0f;    // Overrides TIME_BUDGET if given
+
+    // Distributed rendering, the coordinator hands out tiles to the workers
+    int         coordinator_port = 0;
+    std::string worker_host;
+    int         worker_port      = 0;
+#ifdef RAYTRACER_NO_GUI
+    headless = true;
+#endif
+
+    for(int i = 1; i < argc; i++)
     {
-        std::printf("Usage -- Raytracer.out [description file]\n");
+        if(std::strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if(std::strcmp(argv[i], "--resume") == 0)
+            resume = true;
+        else if(std::strcmp(argv[i], "--time-budget") == 0 && i + 1 < argc)
+            time_budget = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--coordinator") == 0 && i + 1 < argc)
+            coordinator_port = std::atoi(argv[++i]);
+        else if(std::strcmp(argv[i], "--worker") == 0 && i + 1 < argc)
+        {
+            const std::string address = argv[++i];
+            const std::size_t colon   = address.rfind(':');
+            if(colon != std::string::npos)
+            {
+                worker_host = address.substr(0, colon);
+                worker_port = std::atoi(address.c_str() + colon + 1);
+            }
+            if(worker_host.empty() || worker_port <= 0 || worker_port > 65535)
+            {
+                std::cerr << "[Error] Expected host:port after --worker, got: " << address << '\n';
+                return 1;
+            }
+        }
+        else if(description_file == nullptr && argv[i][0] != '-')
+            description_file = argv[i];
+        else
+        {
+            std::cerr << "[Error] Unknown argument: " << argv[i] << '\n';
+            return 1;
+        }
+    }
+
+    if(coordinator_port < 0 || coordinator_port > 65535 || (coordinator_port > 0 && worker_port > 0))
+    {
+        std::cerr << "[Error] Invalid --coordinator port, or both --coordinator and --worker given\n";
+        return 1;
+    }
+
+    if(description_file == nullptr)
+    {
+        std::printf("Usage -- Raytracer.out [description file] [--headless] [--resume] [--time-budget seconds]\n"
+                    "                       [--coordinator port | --worker host:port]\n");
         return 1;
     }
 
     Scene scene;
     try {
-        scene.read_from_file(argv[1]);
+        scene.read_from_file(description_file);
     }
     catch (std::runtime_error& e) {
         std::cerr << e.what() << '\n';
         return -1;
     }
+    if(time_budget >= 0)
+        scene.time_budget = time_budget;
 
     // Image rendering description
     const uint32_t IMAGE_WIDTH  = scene.image_width;
@@ -144,10 +240,8 @@ int main(int argc, char** argv)
 
     image_pixels.reserve(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
 
-    const uint32_t WIDTH_IN_TILES  = IMAGE_WIDTH  / TILE_WIDTH;
-    const uint32_t HEIGHT_IN_TILES = IMAGE_HEIGHT / TILE_HEIGHT;
-    const uint32_t ADDITIONAL_H    = IMAGE_HEIGHT % TILE_HEIGHT;
-    const uint32_t ADDITIONAL_W    = IMAGE_WIDTH % TILE_WIDTH;
+    const uint32_t WIDTH_IN_TILES  = (IMAGE_WIDTH  + TILE_WIDTH  - 1) / TILE_WIDTH;
+    const uint32_t HEIGHT_IN_TILES = (IMAGE_HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT;
 
     printf("---------------------------------\n");
     printf("[INFO ] Scene parameter:\n");
@@ -157,133 +251,137 @@ int main(int argc, char** argv)
     printf("[INFO ]     Tile height:            %d\n", TILE_HEIGHT);
     printf("[INFO ]     Width in tiles:         %d\n", WIDTH_IN_TILES);
     printf("[INFO ]     Height in tiles:        %d\n", HEIGHT_IN_TILES);
-    printf("[INFO ]     Remainder tile width    %d\n", ADDITIONAL_W);
-    printf("[INFO ]     Remainder tile height:  %d\n", ADDITIONAL_H);
     printf("[INFO ]     # of samples per pixel: %d\n", NUM_SAMPLES);
+    if(scene.adaptive_threshold > 0)
+        printf("[INFO ]     Adaptive threshold:     %g (after %d samples)\n", scene.adaptive_threshold, scene.min_samples);
+    if(scene.time_budget > 0)
+        printf("[INFO ]     Time budget:            %g s\n", scene.time_budget);
+    if(scene.checkpoint_interval > 0)
+        printf("[INFO ]     Checkpoint interval:    %g s\n", scene.checkpoint_interval);
     printf("[INFO ]     # of render threads:    %d\n", NUM_THREADS);
     printf("---------------------------------\n");
     
+    if(worker_port > 0)
+    {
+        // Workers only need the tile bounds, the samples go back to the coordinator
+        ImageRenderInfo worker_image;
+        worker_image.image_width  = scene.image_width;
+        worker_image.image_height = scene.image_height;
+        worker_image.world        = &scene;
+        worker_image.camera       = &main_camera;
+        create_tile_sections(worker_image, scene.tile_size, false);
+
+        std::printf("[INFO ] Rendering for the coordinator at %s:%d\n", worker_host.c_str(), worker_port);
+        try {
+            const uint64_t passes = run_render_worker(worker_host, uint16_t(worker_port), worker_image, NUM_THREADS);
+            std::printf("[INFO ] Rendered %llu tile passes\n", (unsigned long long) passes);
+        }
+        catch (std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return -1;
+        }
+        return 0;
+    }
+
     RenderThreadControl thread_control;
-    thread_control.image = {};
     thread_control.image.image_width  = scene.image_width;
     thread_control.image.image_height = scene.image_height;
     thread_control.image.num_samples  = scene.num_samples;
+    thread_control.image.min_samples  = scene.min_samples;
+    thread_control.image.error_threshold = scene.adaptive_threshold;
     thread_control.image.world        = &scene;
     thread_control.image.camera       = &main_camera;
     thread_control.image.pixels       = std::vector<Vec3>(IMAGE_WIDTH * IMAGE_HEIGHT);
-    thread_control.image.section_queue_front = 0;
     thread_control.thread_stats       = std::vector<int>(scene.num_threads);
 
     // Prepare the work units that must be performed by the threads
-    for(uint32_t sample = 0; sample < scene.num_samples; sample++)
+    create_tile_sections(thread_control.image, scene.tile_size);
+
+    const std::string checkpoint_file = scene.name + ".ckpt";
+    if(resume)
     {
-        for(uint32_t tile_y = 0; tile_y < HEIGHT_IN_TILES; tile_y++)
-        {
-            for(uint32_t tile_x = 0; tile_x < WIDTH_IN_TILES; tile_x++)
-            {
-                SectionRenderInfo section = {};
-                section.tile_width  = TILE_WIDTH;
-                section.tile_height = TILE_HEIGHT;
-                section.tile_x      = tile_x * TILE_WIDTH;
-                section.tile_y      = tile_y * TILE_HEIGHT;
-                section.is_finished = false;
-                section.in_progress = false;
-
-                if(tile_x == WIDTH_IN_TILES - 1)
-                    section.tile_width  += ADDITIONAL_W;
-                if(tile_y == HEIGHT_IN_TILES - 1)
-                    section.tile_height += ADDITIONAL_H;
-
-                thread_control.image.sections.push_back(section);
-            }
+        try {
+            read_checkpoint(checkpoint_file, thread_control.image);
+        }
+        catch (std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return -1;
         }
+        std::printf("[INFO ] Resuming from %s, %d / %zu tiles done, %.1f samples per pixel\n",
+                    checkpoint_file.c_str(),
+                    thread_control.image.finished_sections.load(),
+                    thread_control.image.sections.size(),
+                    thread_control.image.average_samples());
     }
-    thread_control.image.total_sections = thread_control.image.sections.size();
-
-    using std::chrono::high_resolution_clock;
-    using std::chrono::duration;
-    using std::chrono::seconds;
 
     std::cout << "[INFO   ] Creating threads...\n";
 
     // Initialize threads
-    auto time_render_begin = high_resolution_clock::now();
+    auto time_render_begin = RenderClock::now();
     std::vector<ThreadHandle> render_threads(scene.num_threads);
 
-    initialize_mutex     (&thread_control);
-    create_render_threads(render_threads.data(), scene.num_threads, &thread_control);
+    if(scene.time_budget > 0)
+        thread_control.image.deadline = std::chrono::steady_clock::now() + 
+                                        std::chrono::milliseconds(uint64_t(1000.0 * scene.time_budget));
 
-    // GUI Display
-    sf::RenderWindow window(sf::VideoMode(IMAGE_WIDTH, IMAGE_HEIGHT), "Render");
-    sf::Image output;
-    output.create(IMAGE_WIDTH, IMAGE_HEIGHT, sf::Color::Black);
-
-    bool output_done = false;    
-    while(window.isOpen())
+    // A coordinator leaves the rendering to its workers
+    std::unique_ptr<RenderCoordinator> coordinator;
+    if(coordinator_port > 0)
     {
-        sf::Event event;
-        while(window.pollEvent(event))
-        {
-            if(event.type == sf::Event::Closed)
-                window.close();
+        coordinator.reset(new RenderCoordinator(thread_control.image, uint16_t(coordinator_port)));
+        try {
+            coordinator->start();
         }
-
-        // Draw
-        window.clear(sf::Color::Black);
-
-        lock_mutex(&thread_control);
-        for(uint32_t y = 0; y < IMAGE_HEIGHT; y++)
-        {
-            for(uint32_t x = 0; x < IMAGE_WIDTH; x++)
-            {
-                const int ypos = IMAGE_HEIGHT - 1 - y;
-                const int xpos = x;
-                const Vec3* pixel = &thread_control.image.pixels[ypos * IMAGE_WIDTH + xpos];
-                output.setPixel(x, y, sf::Color(255.99 * sqrt(clamp(pixel->x(), 0.0f, 1.0f)), 
-                                                255.99 * sqrt(clamp(pixel->y(), 0.0f, 1.0f)), 
-                                                255.99 * sqrt(clamp(pixel->z(), 0.0f, 1.0f))));
-            }
+        catch (std::runtime_error& e) {
+            std::cerr << e.what() << '\n';
+            return -1;
         }
-        unlock_mutex(&thread_control);
-
-        sf::Texture tex;
-        tex.loadFromImage(output);
-        sf::Sprite sprite;
-        sprite.setTexture(tex);
-        window.draw(sprite);
+    }
+    else
+    {
+        initialize_mutex     (&thread_control);
+        create_render_threads(render_threads.data(), scene.num_threads, &thread_control);
+    }
 
-        uint32_t num_finished = 0;
-        for(const SectionRenderInfo& section : thread_control.image.sections)
-        {
-            if(section.in_progress)
-            {
-                sf::RectangleShape rect(sf::Vector2f( (uint32_t) section.tile_width, 
-                                                      (uint32_t) section.tile_height ));
-                rect.setFillColor(sf::Color(0, 0, 0, 0.0));
-                rect.setPosition (section.tile_x , IMAGE_HEIGHT - section.tile_y - section.tile_height);
-                rect.setOutlineThickness(1.0);
-                rect.setOutlineColor(sf::Color(255.0, 255.0, 255.0));
+    std::unique_ptr<CheckpointWriter> checkpoint_writer;
+    if(scene.checkpoint_interval > 0)
+        checkpoint_writer.reset(new CheckpointWriter(checkpoint_file, thread_control.image, scene.checkpoint_interval));
 
-                window.draw(rect);
-            }
-            if(section.is_finished)
-                num_finished++;
-        }
-        
-        if(num_finished == thread_control.image.sections.size() && !output_done)
-        {
-            auto time_render_end   = high_resolution_clock::now();
-            auto time_render_total = duration<scalar>(time_render_end - time_render_begin).count();
-            std::cout << "The render took " << std::fixed << std::setprecision(2)
-                      << time_render_total  << " seconds.\n";
-            output_done = true;
-        }
+    if(headless)
+    {
+        wait_headless(thread_control);
+        print_render_time(time_render_begin);
+    }
+#ifndef RAYTRACER_NO_GUI
+    else
+        run_display(thread_control, time_render_begin);
+#endif
+
+    if(coordinator)
+        coordinator->stop();
+    else
+    {
+        join_render_threads(render_threads.data(), scene.num_threads);
+        cleanup_threads(&thread_control, render_threads.data(), scene.num_threads);
+    }
 
-        window.display();
+    // Writes the final state, so a render stopped by its time budget can
+    // be resumed with more time
+    if(checkpoint_writer)
+        checkpoint_writer->stop();
 
+    std::printf("[INFO ] Average samples per pixel: %.1f\n", thread_control.image.average_samples());
+    if(scene.texture_cache)
+    {
+        const TextureCache::Statistics stats = scene.texture_cache->statistics();
+        const uint64_t lookups = stats.hits + stats.misses;
+        std::printf("[INFO ] Texture cache: %llu hits, %llu misses (%.1f%% hit rate), %.1f MB read, %.1f of %.1f MB in use\n",
+                    (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                    lookups > 0 ? 100.0 * double(stats.hits) / double(lookups) : 0.0,
+                    double(stats.bytes_read) / (1024.0 * 1024.0),
+                    double(stats.bytes_cached) / (1024.0 * 1024.0),
+                    double(scene.texture_cache->budget()) / (1024.0 * 1024.0));
     }
-    join_render_threads(render_threads.data(), scene.num_threads);
-    cleanup_threads(&thread_control, render_threads.data(), scene.num_threads);
 
     for(Vec3& pixel : thread_control.image.pixels)
     {
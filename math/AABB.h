@@ -0,0 +1,121 @@
+#ifndef MATH_AABB_H
+#define MATH_AABB_H
+
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include "Vector.h"
+#include "Ray.h"
+
+/**
+ * Reciprocal of a ray's direction, computed once per ray so that the
+ * slab tests against every box along the way only need multiplications
+ **/
+struct RayInverse
+{
+    RayInverse(const Ray& r):
+        origin (r.origin()),
+        inv_dir(Vec3({ 1.0f / r.direction().x(),
+                       1.0f / r.direction().y(),
+                       1.0f / r.direction().z() }))
+    {
+    }
+
+    Vec3 origin;
+    Vec3 inv_dir;
+};
+
+/**
+ * Axis-aligned bounding box. A default constructed box is empty, i.e.
+ * inverted, so that growing it by anything yields that thing's bounds
+ **/
+class AABB {
+public:
+    AABB():
+        lower(Vec3({  FLT_MAX,  FLT_MAX,  FLT_MAX })),
+        upper(Vec3({ -FLT_MAX, -FLT_MAX, -FLT_MAX }))
+    {
+    }
+
+    AABB(const Vec3& lower, const Vec3& upper):
+        lower(lower), upper(upper)
+    {
+    }
+
+    inline void grow(const Vec3& p)
+    {
+        lower = component_min(lower, p);
+        upper = component_max(upper, p);
+    }
+
+    inline void grow(const AABB& b)
+    {
+        lower = component_min(lower, b.lower);
+        upper = component_max(upper, b.upper);
+    }
+
+    inline Vec3 centroid() const
+    {
+        return 0.5f * lower + 0.5f * upper;
+    }
+
+    inline bool is_empty() const
+    {
+        return upper.x() < lower.x() || upper.y() < lower.y() || upper.z() < lower.z();
+    }
+
+    // True if any side extends to infinity, e.g. the bounds of a plane
+    inline bool is_unbounded() const
+    {
+        for(std::size_t i = 0; i < 3; i++)
+        {
+            if(!(std::fabs(lower[i]) < FLT_MAX) || !(std::fabs(upper[i]) < FLT_MAX))
+                return true;
+        }
+        return false;
+    }
+
+    // Half of the surface area, which is all the SAH needs
+    inline scalar half_area() const
+    {
+        if(is_empty())
+            return 0.0f;
+        const Vec3 e = upper - lower;
+        return e.x() * e.y() + e.y() * e.z() + e.z() * e.x();
+    }
+
+    /**
+     * Slab test, clipped to [t_min, t_max]. On a hit, t_enter and t_exit
+     * hold the parametric range of the ray inside the box. Passing the
+     * current closest hit as t_max rejects boxes that lie behind it.
+     *
+     * There are no branches besides the final comparison; min/max
+     * reorder each slab so that a negative direction needs no swap, and
+     * a NaN produced by a ray lying on a slab plane is discarded since
+     * the running value is always passed as the first argument
+     **/
+    inline bool intersect(const RayInverse& ri,
+                          const scalar      t_min,
+                          const scalar      t_max,
+                          scalar&           t_enter,
+                          scalar&           t_exit) const
+    {
+        scalar t0 = t_min;
+        scalar t1 = t_max;
+        for(std::size_t i = 0; i < 3; i++)
+        {
+            const scalar ta = (lower[i] - ri.origin[i]) * ri.inv_dir[i];
+            const scalar tb = (upper[i] - ri.origin[i]) * ri.inv_dir[i];
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+        t_enter = t0;
+        t_exit  = t1;
+        return t0 <= t1;
+    }
+
+    Vec3 lower;
+    Vec3 upper;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef MATH_SAMPLING_H
+#define MATH_SAMPLING_H
+
+#include <cmath>
+#include <algorithm>
+#include "Vector.h"
+
+/**
+ * Warps of uniform points of [0, 1)^2, as drawn by random_2d(), onto the
+ * domains that directions and points are sampled from. Each takes one 2D
+ * point, so that the stratification of the sampler carries over, and none
+ * calls sin, cos or atan2: angles are only ever taken within [-pi/4, pi/4]
+ * where a short polynomial is exact to float precision.
+ *
+ * Directions are in a local frame whose z axis is the normal, see Frame
+ **/
+
+// Next 2D point of the current sample, see Sampler::next_2d()
+inline Vec2 random_2d()
+{
+    float u, v;
+    Sampler::current().next_2d(u, v);
+    return Vec2({ u, v });
+}
+
+/**
+ * Orthonormal basis around a unit vector n, without branches on its
+ * direction nor a normalization (Duff et al., "Building an Orthonormal
+ * Basis, Revisited", 2017)
+ **/
+struct Frame
+{
+    explicit Frame(const Vec3& n):
+        n(n)
+    {
+        const scalar sign = std::copysign(scalar(1), n.z());
+        const scalar a    = -1 / (sign + n.z());
+        const scalar b    = n.x() * n.y() * a;
+        s = Vec3({ 1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x() });
+        t = Vec3({ b, sign + n.y() * n.y() * a, -n.y() });
+    }
+
+    inline Vec3 to_world(const Vec3& v) const { return s * v.x() + t * v.y() + n * v.z(); }
+    inline Vec3 to_local(const Vec3& v) const { return Vec3({ dot(v, s), dot(v, t), dot(v, n) }); }
+
+    Vec3 s;
+    Vec3 t;
+    Vec3 n;
+};
+
+// sin and cos of an angle within [-pi/4, pi/4], by their Taylor series
+inline void sin_cos_quarter(const scalar a, scalar& sin_a, scalar& cos_a)
+{
+    const scalar a2 = a * a;
+    sin_a = a * (1 - a2 / 6 * (1 - a2 / 20 * (1 - a2 / 42 * (1 - a2 / 72))));
+    cos_a = 1 - a2 / 2 * (1 - a2 / 12 * (1 - a2 / 30 * (1 - a2 / 56)));
+}
+
+/**
+ * Uniform over the unit disk, by the concentric mapping of Shirley and
+ * Chiu, which keeps neighbouring points of the square close on the disk
+ **/
+inline Vec2 sample_uniform_disk(const Vec2& u)
+{
+    const scalar x = 2 * u.x() - 1;
+    const scalar y = 2 * u.y() - 1;
+    if(x == 0 && y == 0)
+        return Vec2({ 0.0f, 0.0f });
+
+    // Each quarter of the square around an axis maps to the sector around
+    // it, whose points are all within pi/4 of the axis
+    scalar r, sin_a, cos_a;
+    if(std::fabs(x) > std::fabs(y))
+    {
+        r = x;
+        sin_cos_quarter(scalar(k_PI / 4) * (y / x), sin_a, cos_a);
+    } else
+    {
+        r = y;
+        sin_cos_quarter(scalar(k_PI / 4) * (x / y), cos_a, sin_a);
+    }
+    return Vec2({ r * cos_a, r * sin_a });
+}
+
+/**
+ * Uniform within a cone of directions around z, given one minus the cosine
+ * of its half angle, passed as is so that narrow cones keep their
+ * precision. 1 gives the hemisphere and 2 the whole sphere. The squared
+ * radius of a uniform disk point is itself uniform, and sets the height
+ **/
+inline Vec3 sample_uniform_cone(const Vec2& u, const scalar one_minus_cos_max)
+{
+    const Vec2   d   = sample_uniform_disk(u);
+    const scalar h   = dot(d, d) * one_minus_cos_max;
+    const scalar xy  = std::sqrt(std::max<scalar>(0.0f, one_minus_cos_max * (2 - h)));
+    return Vec3({ d.x() * xy, d.y() * xy, 1 - h });
+}
+
+inline scalar uniform_cone_pdf(const scalar one_minus_cos_max)
+{
+    return 1 / (2 * k_PI * one_minus_cos_max);
+}
+
+// Uniform over the unit sphere
+inline Vec3 sample_uniform_sphere(const Vec2& u)
+{
+    return sample_uniform_cone(u, 2.0f);
+}
+
+/**
+ * Cosine-weighted over the hemisphere around z, by lifting a uniform disk
+ * point onto it (Malley's method)
+ **/
+inline Vec3 sample_cosine_hemisphere(const Vec2& u)
+{
+    const Vec2 d = sample_uniform_disk(u);
+    return Vec3({ d.x(), d.y(), std::sqrt(std::max<scalar>(0.0f, 1 - dot(d, d))) });
+}
+
+inline scalar cosine_hemisphere_pdf(const scalar cos_theta)
+{
+    return std::max<scalar>(0.0f, cos_theta) / k_PI;
+}
+
+/**
+ * GGX (Trowbridge-Reitz) distribution of microfacet normals h around z,
+ * with roughness alpha, and the Smith masking of direction w
+ **/
+inline scalar ggx_d(const Vec3& h, const scalar alpha)
+{
+    if(h.z() <= 0)
+        return 0.0f;
+    const scalar a2 = alpha * alpha;
+    const scalar d  = h.x() * h.x() + h.y() * h.y() + a2 * h.z() * h.z();
+    return a2 / (k_PI * d * d);
+}
+
+inline scalar ggx_smith_g1(const Vec3& w, const scalar alpha)
+{
+    if(w.z() <= 0)
+        return 0.0f;
+    const scalar a2_tan2 = alpha * alpha * (w.x() * w.x() + w.y() * w.y()) / (w.z() * w.z());
+    return 2 / (1 + std::sqrt(1 + a2_tan2));
+}
+
+/**
+ * A microfacet normal visible from wo (above the surface), drawn in
+ * proportion to how much of it wo sees (Heitz, "Sampling the GGX
+ * Distribution of Visible Normals", 2018), so that no sample is wasted on
+ * facets facing away. Reflecting wo about it gives the scattered direction
+ **/
+inline Vec3 sample_ggx_vndf(const Vec3& wo, const scalar alpha, const Vec2& u)
+{
+    // Stretch the view to where the facets are those of a unit hemisphere
+    const Vec3   vh     = normalize(Vec3({ alpha * wo.x(), alpha * wo.y(), wo.z() }));
+    const scalar len_sq = vh.x() * vh.x() + vh.y() * vh.y();
+    const Vec3   t1     = len_sq > 0 ? Vec3({ -vh.y(), vh.x(), 0.0f }) / std::sqrt(len_sq)
+                                     : Vec3({ 1.0f, 0.0f, 0.0f });
+    const Vec3   t2     = cross(vh, t1);
+
+    // Uniform over the projection of that hemisphere, half a disk and half
+    // an ellipse seen from vh
+    const Vec2   d = sample_uniform_disk(u);
+    const scalar s = 0.5f * (1 + vh.z());
+    const scalar p1 = d.x();
+    const scalar p2 = (1 - s) * std::sqrt(std::max<scalar>(0.0f, 1 - p1 * p1)) + s * d.y();
+
+    const Vec3 nh = p1 * t1 + p2 * t2 + std::sqrt(std::max<scalar>(0.0f, 1 - p1 * p1 - p2 * p2)) * vh;
+    return normalize(Vec3({ alpha * nh.x(), alpha * nh.y(), std::max<scalar>(0.0f, nh.z()) }));
+}
+
+// Density of sample_ggx_vndf() over microfacet normals h
+inline scalar ggx_vndf_pdf(const Vec3& wo, const Vec3& h, const scalar alpha)
+{
+    if(wo.z() <= 0)
+        return 0.0f;
+    return ggx_smith_g1(wo, alpha) * std::max<scalar>(0.0f, dot(wo, h)) * ggx_d(h, alpha) / wo.z();
+}
+
+// Uniformly distributed over the surface of the unit sphere
+inline Vec3 random_unit_vector()
+{
+    return sample_uniform_sphere(random_2d());
+}
+
+// Uniformly distributed within the unit ball
+inline Vec3 random_in_unit_sphere()
+{
+    const Vec3 direction = random_unit_vector();
+    return direction * std::cbrt(random_scalar());
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef MATH_TRANSFORM_H
+#define MATH_TRANSFORM_H
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "Vector.h"
+#include "Ray.h"
+
+/**
+ * Affine transformation stored as the upper 3x4 part of a 4x4 matrix,
+ * i.e. a 3x3 linear part followed by a translation column
+ **/
+class Transform {
+public:
+    Transform()
+    {
+        for(std::size_t r = 0; r < 3; r++)
+            for(std::size_t c = 0; c < 4; c++)
+                m[r][c] = (r == c) ? 1.0f : 0.0f;
+    }
+
+    static Transform translate(const Vec3& offset)
+    {
+        Transform t;
+        t.m[0][3] = offset.x();
+        t.m[1][3] = offset.y();
+        t.m[2][3] = offset.z();
+        return t;
+    }
+
+    static Transform scale(const scalar factor)
+    {
+        Transform t;
+        t.m[0][0] = t.m[1][1] = t.m[2][2] = factor;
+        return t;
+    }
+
+    static Transform rotate_y(const scalar degrees)
+    {
+        const scalar theta = degrees * k_PI / 180.0;
+        const scalar c     = cosf(theta);
+        const scalar s     = sinf(theta);
+
+        Transform t;
+        t.m[0][0] =  c; t.m[0][2] = s;
+        t.m[2][0] = -s; t.m[2][2] = c;
+        return t;
+    }
+
+    // Composition, the right hand side is applied first
+    Transform operator*(const Transform& rhs) const
+    {
+        Transform t;
+        for(std::size_t r = 0; r < 3; r++)
+        {
+            for(std::size_t c = 0; c < 4; c++)
+            {
+                t.m[r][c] = m[r][0] * rhs.m[0][c] +
+                            m[r][1] * rhs.m[1][c] +
+                            m[r][2] * rhs.m[2][c] + (c == 3 ? m[r][3] : 0.0f);
+            }
+        }
+        return t;
+    }
+
+    Transform inverse() const
+    {
+        // Inverse of the linear part through its adjugate
+        const scalar a = m[0][0], b = m[0][1], c = m[0][2];
+        const scalar d = m[1][0], e = m[1][1], f = m[1][2];
+        const scalar g = m[2][0], h = m[2][1], i = m[2][2];
+
+        // A singular transform, e.g. a scale of 0, would only fill rays with inf and NaN
+        const scalar det = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+        if(!(std::fabs(det) >= std::numeric_limits<scalar>::min()))
+            throw std::runtime_error("[Error] Transform is not invertible");
+        const scalar inv_det = 1.0f / det;
+
+        Transform t;
+        t.m[0][0] =  (e * i - f * h) * inv_det;
+        t.m[0][1] = -(b * i - c * h) * inv_det;
+        t.m[0][2] =  (b * f - c * e) * inv_det;
+        t.m[1][0] = -(d * i - f * g) * inv_det;
+        t.m[1][1] =  (a * i - c * g) * inv_det;
+        t.m[1][2] = -(a * f - c * d) * inv_det;
+        t.m[2][0] =  (d * h - e * g) * inv_det;
+        t.m[2][1] = -(a * h - b * g) * inv_det;
+        t.m[2][2] =  (a * e - b * d) * inv_det;
+
+        // Translation becomes -(L^-1 * offset)
+        for(std::size_t r = 0; r < 3; r++)
+        {
+            t.m[r][3] = -(t.m[r][0] * m[0][3] +
+                          t.m[r][1] * m[1][3] +
+                          t.m[r][2] * m[2][3]);
+        }
+        return t;
+    }
+
+    bool is_identity() const
+    {
+        return (*this) == Transform();
+    }
+
+    bool operator==(const Transform& rhs) const
+    {
+        for(std::size_t r = 0; r < 3; r++)
+            for(std::size_t c = 0; c < 4; c++)
+                if(m[r][c] != rhs.m[r][c])
+                    return false;
+        return true;
+    }
+
+    inline Vec3 point(const Vec3& p) const
+    {
+        return Vec3({
+            m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+            m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+            m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3],
+        });
+    }
+
+    inline Vec3 vector(const Vec3& v) const
+    {
+        return Vec3({
+            m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+            m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+            m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z(),
+        });
+    }
+
+    /**
+     * Normals transform with the inverse transpose, so this must be
+     * called on the inverse of the transformation applied to the points
+     **/
+    inline Vec3 normal_from_inverse(const Vec3& n) const
+    {
+        return Vec3({
+            m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+            m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+            m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z(),
+        });
+    }
+
+    // The direction is not renormalized so that distances along the
+    // transformed ray correspond to the same t as the original ray
+    inline Ray ray(const Ray& r) const
+    {
+        return Ray(point(r.origin()), vector(r.direction()));
+    }
+
+    scalar m[3][4];
+};
+
+#endif
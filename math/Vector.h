@@ -3,10 +3,18 @@
 #define MATH_VECTOR_H
 
 #include <cassert>
+#include <cmath>
 #include <array>
+#include <algorithm>
 #include <iostream>
 #include "../util/General.h"    // random_scalar()
 
+// Define RAYTRACER_NO_SIMD to keep Vec3 a plain array of three scalars
+#if !defined(RAYTRACER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VECTOR_SSE
+#include <emmintrin.h>
+#endif
+
 // For MSVC support
 const scalar k_PI = 3.14159265358979323846264338327950288;
 
@@ -70,15 +78,6 @@ public:
         return result;
     }
 
-    inline Vector<3> cross(const Vector<3>& v2) const
-    {
-        return Vector<3>({
-            y() * v2.z() - z() * v2.y(),
-            z() * v2.x() - x() * v2.z(),
-            x() * v2.y() - y() * v2.x()
-        });
-    }
-
     template <std::size_t D = N>
     inline typename std::enable_if< D >= 1, scalar>::type x() const { return comp[0]; }
 
@@ -136,17 +135,258 @@ private:
     scalar comp[N];
 };
 
+/**
+ * Vec3, and Color, padded to four components so that with SSE the whole
+ * vector sits in one 16 byte register: arithmetic, dot and cross products,
+ * normalization and min / max are each a few instructions rather than a
+ * loop. The fourth component is kept at 0 and left out of every sum.
+ * Without SSE, or with RAYTRACER_NO_SIMD, it is three scalars as before
+ **/
+template <>
+class Vector<3> {
+    template <std::size_t D>
+    friend std::ostream& operator<<(std::ostream& os, const Vector<D>& v);
+
+public:
+    constexpr Vector():
+        comp{ 0.0f, 0.0f, 0.0f }
+    {
+    }
+    constexpr Vector(const std::array<scalar, 3>& val):
+        comp{ val[0], val[1], val[2] }
+    {
+    }
+
+    std::size_t size() const { return 3; }
+
+#if defined(VECTOR_SSE)
+    explicit Vector(const __m128 m)
+    {
+        _mm_store_ps(comp, m);
+    }
+
+    // The register of the vector, its fourth lane 0
+    inline __m128 m128() const { return _mm_load_ps(comp); }
+#endif
+
+    inline Vector& operator+=(const Vector<3>& v2)
+    {
+#if defined(VECTOR_SSE)
+        _mm_store_ps(comp, _mm_add_ps(m128(), v2.m128()));
+#else
+        for(std::size_t i = 0; i < 3; i++)
+            comp[i] += v2[i];
+#endif
+        return *this;
+    }
+
+    inline Vector& operator-=(const Vector<3>& v2)
+    {
+#if defined(VECTOR_SSE)
+        _mm_store_ps(comp, _mm_sub_ps(m128(), v2.m128()));
+#else
+        for(std::size_t i = 0; i < 3; i++)
+            comp[i] -= v2[i];
+#endif
+        return *this;
+    }
+
+    inline Vector operator-() const
+    {
+#if defined(VECTOR_SSE)
+        return Vector(_mm_xor_ps(m128(), _mm_set1_ps(-0.0f)));
+#else
+        return Vector({ -comp[0], -comp[1], -comp[2] });
+#endif
+    }
+
+    inline Vector& operator*=(const scalar f)
+    {
+#if defined(VECTOR_SSE)
+        _mm_store_ps(comp, _mm_mul_ps(m128(), _mm_set1_ps(f)));
+#else
+        for(std::size_t i = 0; i < 3; i++)
+            comp[i] *= f;
+#endif
+        return *this;
+    }
+
+    inline Vector& operator/=(const scalar f)
+    {
+        return *this *= (scalar) 1 / f;
+    }
+
+    inline scalar dot(const Vector<3>& v2) const
+    {
+#if defined(VECTOR_SSE)
+        return _mm_cvtss_f32(dot_m128(m128(), v2.m128()));
+#else
+        return comp[0] * v2[0] + comp[1] * v2[1] + comp[2] * v2[2];
+#endif
+    }
+
+    inline Vector<3> cross(const Vector<3>& v2) const
+    {
+#if defined(VECTOR_SSE)
+        const __m128 a = m128();
+        const __m128 b = v2.m128();
+        const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+        const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+        return Vector(_mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+#else
+        return Vector<3>({
+            y() * v2.z() - z() * v2.y(),
+            z() * v2.x() - x() * v2.z(),
+            x() * v2.y() - y() * v2.x()
+        });
+#endif
+    }
+
+    inline scalar x() const { return comp[0]; }
+    inline scalar y() const { return comp[1]; }
+    inline scalar z() const { return comp[2]; }
+    inline scalar r() const { return comp[0]; }
+    inline scalar g() const { return comp[1]; }
+    inline scalar b() const { return comp[2]; }
+    inline scalar u() const { return comp[0]; }
+    inline scalar v() const { return comp[1]; }
+
+    inline scalar magnitude_squared() const
+    {
+        return dot(*this);
+    }
+
+    inline scalar magnitude() const
+    {
+        return sqrt(magnitude_squared());
+    }
+
+    /**
+     * With SSE, by the reciprocal square root estimate refined by one
+     * Newton-Raphson step, which is within a few ulps of dividing by the
+     * magnitude. The estimate differs slightly between CPU vendors
+     **/
+    inline Vector& normalize()
+    {
+#if defined(VECTOR_SSE)
+        const __m128 v      = m128();
+        const __m128 d      = dot_m128(v, v);
+        const __m128 len_sq = _mm_shuffle_ps(d, d, _MM_SHUFFLE(0, 0, 0, 0));
+        const __m128 r      = _mm_rsqrt_ps(len_sq);
+        const __m128 half_x = _mm_mul_ps(_mm_set1_ps(0.5f), len_sq);
+        const __m128 inv    = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(half_x, _mm_mul_ps(r, r))));
+        _mm_store_ps(comp, _mm_mul_ps(v, inv));
+#else
+        *this /= magnitude();
+#endif
+        return *this;
+    }
+
+    inline scalar* begin() { return &comp[0]; }
+    inline scalar* end()   { return &comp[3]; }
+
+    inline const scalar* begin() const { return &comp[0]; }
+    inline const scalar* end()   const { return &comp[3]; }
+
+    inline scalar& operator[](std::size_t i)       { return comp[i]; }
+    inline scalar  operator[](std::size_t i) const { return comp[i]; }
+
+#if defined(VECTOR_SSE)
+    // x * x' + y * y' + z * z' in the first lane, summed in that order
+    static inline __m128 dot_m128(const __m128 a, const __m128 b)
+    {
+        const __m128 p  = _mm_mul_ps(a, b);
+        const __m128 xy = _mm_add_ss(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_add_ss(xy, _mm_movehl_ps(p, p));
+    }
+#endif
+private:
+#if defined(VECTOR_SSE)
+    alignas(16) scalar comp[4];
+#else
+    scalar comp[3];
+#endif
+};
+
 using Vec2  = Vector<2>;
 using Vec3  = Vector<3>;
 using Color = Vector<3>;
 
 inline Vector<3> cross(const Vector<3>& v1, const Vector<3>& v2)
 {
-    return Vector<3>({
-        v1.y() * v2.z() - v1.z() * v2.y(),
-        v1.z() * v2.x() - v1.x() * v2.z(),
-        v1.x() * v2.y() - v1.y() * v2.x()
-    });
+    return v1.cross(v2);
+}
+
+// Vec3 versions of the operations below, on whole registers with SSE
+
+inline scalar dot(const Vec3& v1, const Vec3& v2)
+{
+    return v1.dot(v2);
+}
+
+inline Vec3 operator+(const Vec3& v1, const Vec3& v2)
+{
+    Vec3 result = v1;
+    return result += v2;
+}
+
+inline Vec3 operator-(const Vec3& v1, const Vec3& v2)
+{
+    Vec3 result = v1;
+    return result -= v2;
+}
+
+inline Vec3 operator*(const Vec3& v1, const Vec3& v2)
+{
+#if defined(VECTOR_SSE)
+    return Vec3(_mm_mul_ps(v1.m128(), v2.m128()));
+#else
+    return Vec3({ v1.x() * v2.x(), v1.y() * v2.y(), v1.z() * v2.z() });
+#endif
+}
+
+inline Vec3 operator*(const Vec3& v1, const scalar f)
+{
+    Vec3 result = v1;
+    return result *= f;
+}
+
+inline Vec3 operator*(const scalar f, const Vec3& v1)
+{
+    return v1 * f;
+}
+
+inline Vec3 operator/(const Vec3& v1, const scalar f)
+{
+    const scalar denom = 1.0 / f;
+    return v1 * denom;
+}
+
+inline Vec3 normalize(const Vec3& v)
+{
+    Vec3 result = v;
+    return result.normalize();
+}
+
+// Smaller and larger of each pair of components, as std::min() and std::max() would pick
+inline Vec3 component_min(const Vec3& v1, const Vec3& v2)
+{
+#if defined(VECTOR_SSE)
+    return Vec3(_mm_min_ps(v2.m128(), v1.m128()));
+#else
+    return Vec3({ std::min(v1.x(), v2.x()), std::min(v1.y(), v2.y()), std::min(v1.z(), v2.z()) });
+#endif
+}
+
+inline Vec3 component_max(const Vec3& v1, const Vec3& v2)
+{
+#if defined(VECTOR_SSE)
+    return Vec3(_mm_max_ps(v2.m128(), v1.m128()));
+#else
+    return Vec3({ std::max(v1.x(), v2.x()), std::max(v1.y(), v2.y()), std::max(v1.z(), v2.z()) });
+#endif
 }
 
 template <std::size_t N>
@@ -229,18 +469,6 @@ inline Vector<N> reflect(const Vector<N>& vec, const Vector<N>& normal)
     return vec - 2 * dot(vec, normal) * normal;
 }
 
-inline Vec3 random_in_unit_sphere()
-{
-    const scalar rand_theta = random_scalar(0.0, 2 * k_PI);
-    const scalar rand_phi   = random_scalar(0.0, 2 * k_PI);
-    
-    return Vec3({
-        cosf(rand_theta) * sinf(rand_phi),
-        sinf(rand_theta) * sinf(rand_phi),
-        cosf(rand_phi),
-    });
-}
-
 inline Vec3 refract(const Vec3& incident, const Vec3& normal, const scalar ior)
 {
     Vec3 I      = normalize(incident);
@@ -50,12 +50,11 @@ void write_bmp_to_file(const char*    file_name,
     }
 }
 
-std::unique_ptr<uint8_t> read_from_bmp_file(const char* file_name,
-                                            uint32_t* image_width,
-                                            uint32_t* image_height,
-                                            uint32_t* bytes_per_pixel)
+std::unique_ptr<uint8_t[]> read_from_bmp_file(const char* file_name,
+                                              uint32_t* image_width,
+                                              uint32_t* image_height,
+                                              uint32_t* bytes_per_pixel)
 {
-    // TODO: Error checking
     std::ifstream input_file(file_name, std::ios::binary);
 
     if(!input_file)
@@ -66,6 +65,9 @@ std::unique_ptr<uint8_t> read_from_bmp_file(const char* file_name,
 
     input_file.read((char*)&bmpInfoHeader, sizeof(BitmapInfoHeader));
     input_file.read((char*)&bmpDibHeader , sizeof(BitmapDIBHeader));
+
+    if(!input_file || bmpInfoHeader.id != 0x4d42 || bmpDibHeader.compression != 0 || bmpDibHeader.bits_per_pixel < 8)
+        return nullptr;
     
     if(image_width)     *image_width     = bmpDibHeader.width;
     if(image_height)    *image_height    = bmpDibHeader.height;
@@ -73,22 +75,22 @@ std::unique_ptr<uint8_t> read_from_bmp_file(const char* file_name,
 
     const uint32_t width       = bmpDibHeader.width;
     const uint32_t height      = bmpDibHeader.height;
-    const uint32_t bpp         = *bytes_per_pixel;
-    const uint32_t total_bytes = width * height * bpp;
+    const uint32_t bpp         = bmpDibHeader.bits_per_pixel / 8;
+    const std::size_t total_bytes = std::size_t(width) * height * bpp;
 
     const uint32_t padding     = (4 - ( width * bpp ) % 4) % 4;
     const uint32_t pixels_w    = width * bpp;
-    const uint32_t bytes_w     = pixels_w + padding;
 
-    uint8_t* pixels = new uint8_t[ total_bytes ];
-
-    uint32_t pad_bytes = 0;
+    std::unique_ptr<uint8_t[]> pixels(new uint8_t[ total_bytes ]);
 
+    // The pixel array need not follow the headers directly, and the rows
+    // in the file are padded to 4 bytes while those returned are not
+    input_file.seekg(bmpInfoHeader.offset);
     for(uint32_t y = 0; y < height; y++)
     {
-        input_file.read((char*)(pixels + (y * bytes_w)), pixels_w);
-        input_file.read((char*)&pad_bytes, padding);
+        if(!input_file.read((char*)(pixels.get() + std::size_t(y) * pixels_w), pixels_w))
+            return nullptr;
+        input_file.ignore(padding);
     }
-
-    return std::unique_ptr<uint8_t>(pixels);
+    return pixels;
 }
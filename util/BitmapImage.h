@@ -39,8 +39,12 @@ void write_bmp_to_file (const char*    file_name,
                         const uint32_t height,
                         const uint32_t bytes_per_pixel);
 
-std::unique_ptr<uint8_t> read_from_bmp_file(const char* file_name,
-                                            uint32_t*   image_width,
-                                            uint32_t*   image_height,
-                                            uint32_t*   bytes_per_pixel);
+/**
+ * Reads an uncompressed .BMP file into tightly packed rows, bottom row
+ * first as in the file. Returns nullptr if it cannot be read
+ **/
+std::unique_ptr<uint8_t[]> read_from_bmp_file(const char* file_name,
+                                              uint32_t*   image_width,
+                                              uint32_t*   image_height,
+                                              uint32_t*   bytes_per_pixel);
 #endif
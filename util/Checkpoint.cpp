@@ -0,0 +1,158 @@
+#include "Checkpoint.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint32_t CHECKPOINT_MAGIC   = 0x4B435452;   // "RTCK" read as little endian
+    constexpr uint32_t CHECKPOINT_VERSION = 1;
+}
+
+bool write_checkpoint(const std::string& file_path, ImageRenderInfo& image)
+{
+    const std::string temp_path = file_path + ".tmp";
+    std::ofstream output_file(temp_path, std::ios::binary | std::ios::trunc);
+    if(!output_file)
+        return false;
+
+    CheckpointHeader header;
+    header.magic        = CHECKPOINT_MAGIC;
+    header.version      = CHECKPOINT_VERSION;
+    header.image_width  = image.image_width;
+    header.image_height = image.image_height;
+    header.num_sections = image.sections.size();
+    output_file.write(reinterpret_cast<char*>(&header), sizeof(header));
+
+    std::vector<Vec3>   mean;
+    std::vector<scalar> m2;
+    for(SectionRenderInfo& section : image.sections)
+    {
+        CheckpointSection record;
+        {
+            // Waits for a pass in progress to finish, which keeps the copy
+            // consistent with passes_done
+            std::lock_guard<std::mutex> render_guard(section.render_lock);
+            record.tile_x      = section.tile_x;
+            record.tile_y      = section.tile_y;
+            record.tile_width  = section.tile_width;
+            record.tile_height = section.tile_height;
+            record.passes_done = section.passes_done;
+            record.is_done     = section.is_done ? 1 : 0;
+            mean = section.mean;
+            m2   = section.m2;
+        }
+
+        output_file.write(reinterpret_cast<char*>(&record), sizeof(record));
+        for(const Vec3& color : mean)
+            output_file.write(reinterpret_cast<const char*>(color.begin()), 3 * sizeof(scalar));
+        output_file.write(reinterpret_cast<const char*>(m2.data()), m2.size() * sizeof(scalar));
+    }
+
+    output_file.close();
+    if(!output_file)
+        return false;
+
+    // rename() does not replace an existing file everywhere
+    if(std::rename(temp_path.c_str(), file_path.c_str()) != 0)
+    {
+        std::remove(file_path.c_str());
+        return std::rename(temp_path.c_str(), file_path.c_str()) == 0;
+    }
+    return true;
+}
+
+void read_checkpoint(const std::string& file_path, ImageRenderInfo& image)
+{
+    std::ifstream input_file(file_path, std::ios::binary);
+    if(!input_file)
+        throw std::runtime_error("[Error] Could not open the checkpoint: " + file_path);
+
+    CheckpointHeader header;
+    if(!input_file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       header.magic   != CHECKPOINT_MAGIC ||
+       header.version != CHECKPOINT_VERSION)
+        throw std::runtime_error("[Error] Not a valid checkpoint: " + file_path);
+
+    if(header.image_width  != image.image_width  ||
+       header.image_height != image.image_height ||
+       header.num_sections != image.sections.size())
+        throw std::runtime_error("[Error] The checkpoint was made for a different image or tile size");
+
+    image.finished_sections = 0;
+    for(SectionRenderInfo& section : image.sections)
+    {
+        CheckpointSection record;
+        if(!input_file.read(reinterpret_cast<char*>(&record), sizeof(record)))
+            throw std::runtime_error("[Error] The checkpoint is truncated");
+
+        if(record.tile_x      != section.tile_x     || record.tile_y      != section.tile_y ||
+           record.tile_width  != section.tile_width || record.tile_height != section.tile_height)
+            throw std::runtime_error("[Error] The checkpoint was made for a different tile layout");
+
+        for(Vec3& color : section.mean)
+            input_file.read(reinterpret_cast<char*>(color.begin()), 3 * sizeof(scalar));
+        input_file.read(reinterpret_cast<char*>(section.m2.data()), section.m2.size() * sizeof(scalar));
+        if(!input_file)
+            throw std::runtime_error("[Error] The checkpoint is truncated");
+
+        // A tile that ran out of samples picks up again if the scene now
+        // asks for more, one that converged stays done while adaptive
+        // sampling is still enabled
+        const bool converged = record.is_done != 0 && image.error_threshold > 0 &&
+                               record.passes_done >= image.min_samples;
+        section.passes_done = record.passes_done;
+        section.is_done     = converged || record.passes_done >= image.num_samples;
+        if(section.is_done)
+            image.finished_sections++;
+
+        for(uint32_t y = 0; y < section.tile_height; y++)
+        {
+            for(uint32_t x = 0; x < section.tile_width; x++)
+                image.pixels[(section.tile_y + y) * image.image_width + section.tile_x + x] = 
+                    section.mean[y * section.tile_width + x];
+        }
+    }
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& file_path, ImageRenderInfo& image, const double interval_seconds):
+    file_path(file_path),
+    image(image),
+    interval_seconds(interval_seconds)
+{
+    writer = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    stop();
+}
+
+void CheckpointWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stop_requested = true;
+    }
+    wake.notify_one();
+    if(writer.joinable())
+        writer.join();
+}
+
+void CheckpointWriter::run()
+{
+    const auto interval = std::chrono::milliseconds(uint64_t(1000.0 * interval_seconds));
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!stop_requested)
+    {
+        wake.wait_for(lock, interval, [this] { return stop_requested; });
+
+        lock.unlock();
+        if(!write_checkpoint(file_path, image))
+            std::cerr << "[WARNING] Could not write the checkpoint: " << file_path << '\n';
+        lock.lock();
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef UTIL_CHECKPOINT_H
+#define UTIL_CHECKPOINT_H
+
+#include "Threading.h"
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#pragma pack(1)
+struct CheckpointHeader
+{
+    uint32_t magic;             // 'R', 'T', 'C', 'K'
+    uint32_t version;
+    uint32_t image_width;
+    uint32_t image_height;
+    uint32_t num_sections;
+};
+
+/**
+ * Followed by tile_width * tile_height mean colors (3 floats each) and
+ * as many luminance M2 values. Every pixel of a tile has passes_done
+ * samples, so that is also the per pixel sample count
+ **/
+struct CheckpointSection
+{
+    uint32_t tile_x;
+    uint32_t tile_y;
+    uint32_t tile_width;
+    uint32_t tile_height;
+    uint32_t passes_done;
+    uint8_t  is_done;
+};
+#pragma pack()
+
+/**
+ * Writes the accumulated state of every tile to file_path. Each tile is
+ * copied under its render_lock, so this may run alongside the render
+ * threads. The file is written under a temporary name and then renamed,
+ * so a crash midway leaves the previous checkpoint intact
+ **/
+bool write_checkpoint(const std::string& file_path, ImageRenderInfo& image);
+
+/**
+ * Restores the tiles from a checkpoint into image, whose sections must 
+ * already have been created for the same image and tile size, and 
+ * publishes their pixels. Throws if the file does not match the image
+ **/
+void read_checkpoint(const std::string& file_path, ImageRenderInfo& image);
+
+/**
+ * Background thread writing a checkpoint every interval, and once more
+ * when stopped, so that the render threads never wait on the disk
+ **/
+class CheckpointWriter {
+public:
+    CheckpointWriter(const std::string& file_path, ImageRenderInfo& image, const double interval_seconds);
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&)            = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    void stop();
+private:
+    void run();
+
+    std::string      file_path;
+    ImageRenderInfo& image;
+    double           interval_seconds;
+
+    std::thread             writer;
+    std::mutex              mutex;
+    std::condition_variable wake;
+    bool                    stop_requested = false;
+};
+
+#endif
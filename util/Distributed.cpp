@@ -0,0 +1,488 @@
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+// Must come before windows.h, which Threading.h includes
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define RAYTRACER_WINSOCK
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif
+
+#include "Distributed.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint32_t MESSAGE_MAGIC = 0x53445452;   // "RTDS" read as little endian
+
+#ifdef RAYTRACER_WINSOCK
+    constexpr SocketHandle INVALID_HANDLE = SocketHandle(INVALID_SOCKET);
+    constexpr int          SEND_FLAGS     = 0;
+
+    void initialize_sockets()
+    {
+        static const bool initialized = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        if(!initialized)
+            throw std::runtime_error("[Error] Could not initialize Winsock");
+    }
+
+    void close_socket(SocketHandle s)    { closesocket(SOCKET(s)); }
+    void shutdown_socket(SocketHandle s) { shutdown(SOCKET(s), SD_BOTH); }
+#else
+    constexpr SocketHandle INVALID_HANDLE = -1;
+    constexpr int          SEND_FLAGS     = MSG_NOSIGNAL;   // A lost peer is an error, not a signal
+
+    void initialize_sockets() {}
+
+    void close_socket(SocketHandle s)    { close(s); }
+    void shutdown_socket(SocketHandle s) { shutdown(s, SHUT_RDWR); }
+#endif
+
+    bool send_all(SocketHandle s, const void* data, std::size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while(size > 0)
+        {
+            const int sent = send(s, bytes, int(std::min<std::size_t>(size, 1 << 20)), SEND_FLAGS);
+            if(sent <= 0)
+                return false;
+            bytes += sent;
+            size  -= sent;
+        }
+        return true;
+    }
+
+    bool receive_all(SocketHandle s, void* data, std::size_t size)
+    {
+        char* bytes = static_cast<char*>(data);
+        while(size > 0)
+        {
+            const int received = recv(s, bytes, int(std::min<std::size_t>(size, 1 << 20)), 0);
+            if(received <= 0)
+                return false;
+            bytes += received;
+            size  -= received;
+        }
+        return true;
+    }
+
+    bool send_message(SocketHandle s, const MessageType type, const uint32_t a = 0, const uint32_t b = 0, const uint32_t c = 0)
+    {
+        const MessageHeader header = { MESSAGE_MAGIC, type, a, b, c };
+        return send_all(s, &header, sizeof(header));
+    }
+
+    bool receive_message(SocketHandle s, MessageHeader& header)
+    {
+        return receive_all(s, &header, sizeof(header)) && header.magic == MESSAGE_MAGIC;
+    }
+
+    // Small messages go out at once, and peers which vanish without a word are noticed
+    void configure_connection(SocketHandle s)
+    {
+        const int enable = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY,  reinterpret_cast<const char*>(&enable), sizeof(enable));
+        setsockopt(s, SOL_SOCKET,  SO_KEEPALIVE, reinterpret_cast<const char*>(&enable), sizeof(enable));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+        // Probed after 10 s of silence and dropped after 3 unanswered probes
+        // 5 s apart, rather than after the default of about two hours
+        const int idle = 10, interval = 5, count = 3;
+        setsockopt(s, IPPROTO_TCP, TCP_KEEPIDLE,  reinterpret_cast<const char*>(&idle),     sizeof(idle));
+        setsockopt(s, IPPROTO_TCP, TCP_KEEPINTVL, reinterpret_cast<const char*>(&interval), sizeof(interval));
+        setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT,   reinterpret_cast<const char*>(&count),    sizeof(count));
+#endif
+    }
+
+    /**
+     * Bounds every blocking receive on s, so that a peer which stops in
+     * the middle of a message, e.g. because it is suspended, is given up on
+     **/
+    void set_receive_timeout(SocketHandle s, const uint32_t seconds)
+    {
+#ifdef RAYTRACER_WINSOCK
+        const DWORD timeout = DWORD(seconds) * 1000;
+#else
+        const timeval timeout = { time_t(seconds), 0 };
+#endif
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    }
+
+    // Whether s has something to read, or was closed, within milliseconds
+    bool wait_readable(SocketHandle s, const uint32_t milliseconds)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(s, &readable);
+        timeval timeout = { long(milliseconds / 1000), long(milliseconds % 1000) * 1000 };
+        return select(int(s + 1), &readable, nullptr, nullptr, &timeout) > 0;
+    }
+
+    SocketHandle connect_to(const std::string& host, const uint16_t port)
+    {
+        addrinfo hints = {};
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* addresses = nullptr;
+        if(getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+            return INVALID_HANDLE;
+
+        SocketHandle s = INVALID_HANDLE;
+        for(addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+        {
+            s = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if(s == INVALID_HANDLE)
+                continue;
+            if(connect(s, address->ai_addr, int(address->ai_addrlen)) == 0)
+                break;
+            close_socket(s);
+            s = INVALID_HANDLE;
+        }
+        freeaddrinfo(addresses);
+
+        if(s != INVALID_HANDLE)
+            configure_connection(s);
+        return s;
+    }
+}
+
+RenderCoordinator::RenderCoordinator(ImageRenderInfo& image, const uint16_t port):
+    image(image),
+    port(port),
+    listener(INVALID_HANDLE)
+{
+}
+
+RenderCoordinator::~RenderCoordinator()
+{
+    stop();
+}
+
+void RenderCoordinator::start()
+{
+    initialize_sockets();
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if(listener == INVALID_HANDLE)
+        throw std::runtime_error("[Error] Could not create the coordinator's socket");
+
+    const int enable = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable));
+
+    sockaddr_in address = {};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(port);
+    if(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        close_socket(listener);
+        listener = INVALID_HANDLE;
+        throw std::runtime_error("[Error] Could not listen on port " + std::to_string(port));
+    }
+
+    passes_out.assign(image.sections.size(), 0);
+    next_sample.resize(image.sections.size());
+    for(std::size_t i = 0; i < image.sections.size(); i++)
+        next_sample[i] = image.sections[i].passes_done;
+    image.running_threads = 1;
+
+    std::printf("[INFO ] Waiting for workers on port %d\n", port);
+    acceptor = std::thread(&RenderCoordinator::accept_workers, this);
+}
+
+void RenderCoordinator::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+
+        // Wakes up workers which connected but never said hello
+        for(SocketHandle connection : connections)
+            shutdown_socket(connection);
+    }
+    work_changed.notify_all();
+
+    if(acceptor.joinable())
+        acceptor.join();
+    for(std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+
+    if(listener != INVALID_HANDLE)
+    {
+        close_socket(listener);
+        listener = INVALID_HANDLE;
+    }
+    image.running_threads = 0;
+}
+
+bool RenderCoordinator::is_render_over() const
+{
+    // Once the time budget is spent, passes still out are not waited for
+    if(std::chrono::steady_clock::now() >= image.deadline)
+        return true;
+    return total_out == 0 && image.finished_sections == image.sections.size();
+}
+
+std::chrono::steady_clock::duration RenderCoordinator::answer_timeout() const
+{
+    return std::max<std::chrono::steady_clock::duration>(std::chrono::seconds(MIN_ANSWER_TIMEOUT),
+                                                         ANSWER_TIMEOUT_FACTOR * slowest_answer);
+}
+
+bool RenderCoordinator::wait_for_answer(SocketHandle connection)
+{
+    const auto assigned = std::chrono::steady_clock::now();
+    while(true)
+    {
+        // Polls, so that stop() and the time budget are noticed
+        if(wait_readable(connection, 250))
+            break;
+
+        std::lock_guard<std::mutex> guard(mutex);
+        if(stopping || is_render_over() || std::chrono::steady_clock::now() - assigned > answer_timeout())
+            return false;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex);
+    slowest_answer = std::max(slowest_answer, std::chrono::steady_clock::now() - assigned);
+    return true;
+}
+
+void RenderCoordinator::accept_workers()
+{
+    while(true)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if(stopping)
+                break;
+            if(is_render_over())
+                image.running_threads = 0;
+        }
+
+        // Polls, so that the deadline and stop() are noticed
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listener, &readable);
+        timeval timeout = { 0, 250000 };
+        if(select(int(listener + 1), &readable, nullptr, nullptr, &timeout) <= 0)
+            continue;
+
+        const SocketHandle connection = accept(listener, nullptr, nullptr);
+        if(connection == INVALID_HANDLE)
+            continue;
+        configure_connection(connection);
+        set_receive_timeout(connection, MIN_ANSWER_TIMEOUT);
+
+        std::lock_guard<std::mutex> guard(mutex);
+        if(stopping)
+        {
+            close_socket(connection);
+            break;
+        }
+        connections.push_back(connection);
+        workers.emplace_back(&RenderCoordinator::serve_worker, this, connection);
+    }
+}
+
+bool RenderCoordinator::next_assignment(uint32_t& tile, uint32_t& num_passes, uint32_t& first_sample)
+{
+    const uint32_t num_sections = image.sections.size();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true)
+    {
+        if(stopping || is_render_over())
+            return false;
+
+        if(std::chrono::steady_clock::now() < image.deadline)
+        {
+            for(uint32_t i = 0; i < num_sections; i++)
+            {
+                const uint32_t candidate = (next_tile + i) % num_sections;
+                const SectionRenderInfo& section = image.sections[candidate];
+                if(section.is_done)
+                    continue;
+
+                // Counts a chunk twice between its merge and its release,
+                // which can only delay handing out the last few passes
+                const uint32_t planned = section.passes_done + passes_out[candidate];
+                if(planned >= image.num_samples)
+                    continue;
+
+                tile       = candidate;
+                num_passes   = std::min(PASSES_PER_ASSIGNMENT, image.num_samples - planned);
+                first_sample = next_sample[tile];
+                next_sample[tile] += num_passes;
+                passes_out[tile]  += num_passes;
+                total_out        += num_passes;
+                image.sections[tile].in_progress = true;
+                next_tile         = candidate + 1;
+                return true;
+            }
+        }
+
+        // Everything left is out, though it may yet come back
+        work_changed.wait_for(lock, std::chrono::milliseconds(250));
+    }
+}
+
+void RenderCoordinator::release_assignment(const uint32_t tile, const uint32_t num_passes)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        passes_out[tile] -= num_passes;
+        total_out        -= num_passes;
+        image.sections[tile].in_progress = passes_out[tile] > 0;
+        if(is_render_over())
+            image.running_threads = 0;
+    }
+    work_changed.notify_all();
+}
+
+void RenderCoordinator::serve_worker(SocketHandle connection)
+{
+    MessageHeader hello;
+    const bool same_scene = receive_message(connection, hello) &&
+                            hello.type == MessageType::HELLO   &&
+                            hello.a    == image.image_width    &&
+                            hello.b    == image.image_height   &&
+                            hello.c    == image.sections.size();
+    if(!same_scene)
+        std::cerr << "[WARNING] Turned away a worker with a different scene or tile size\n";
+
+    std::vector<scalar> payload;
+    std::vector<Vec3>   mean;
+    uint32_t tile         = 0;
+    uint32_t num_passes   = 0;
+    uint32_t first_sample = 0;
+    while(same_scene && next_assignment(tile, num_passes, first_sample))
+    {
+        SectionRenderInfo& section = image.sections[tile];
+        const std::size_t  size    = section.mean.size();
+
+        MessageHeader result;
+        payload.resize(4 * size);
+        const bool answered = send_message(connection, MessageType::ASSIGN, tile, num_passes, first_sample) &&
+                              wait_for_answer(connection)           &&
+                              receive_message(connection, result)   &&
+                              result.type == MessageType::RESULT    &&
+                              result.a    == tile                   &&
+                              result.b    == num_passes             &&
+                              receive_all(connection, payload.data(), payload.size() * sizeof(scalar));
+        if(!answered)
+        {
+            bool over;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                over = stopping || is_render_over();
+            }
+            if(!over)
+                std::cerr << "[WARNING] Lost a worker, or it stopped answering, its tile goes back to the pool\n";
+            release_assignment(tile, num_passes);
+            break;
+        }
+
+        mean.resize(size);
+        for(std::size_t i = 0; i < size; i++)
+            mean[i] = Vec3({ payload[3 * i], payload[3 * i + 1], payload[3 * i + 2] });
+        {
+            std::lock_guard<std::mutex> render_guard(section.render_lock);
+            merge_section_samples(&image, &section, num_passes, mean.data(), payload.data() + 3 * size);
+        }
+        release_assignment(tile, num_passes);
+    }
+
+    send_message(connection, MessageType::DONE);
+
+    std::lock_guard<std::mutex> guard(mutex);
+    connections.erase(std::find(connections.begin(), connections.end(), connection));
+    close_socket(connection);
+}
+
+uint64_t run_render_worker(const std::string& host, const uint16_t port,
+                           const ImageRenderInfo& image, const uint32_t num_connections)
+{
+    initialize_sockets();
+
+    std::atomic<uint64_t> passes_rendered   { 0 };
+    std::atomic<uint32_t> connections_made  { 0 };
+
+    auto render_assignments = [&]() {
+        // The coordinator may still be starting up
+        SocketHandle connection = INVALID_HANDLE;
+        for(int attempt = 0; attempt < 40 && connection == INVALID_HANDLE; attempt++)
+        {
+            connection = connect_to(host, port);
+            if(connection == INVALID_HANDLE)
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        }
+        if(connection == INVALID_HANDLE)
+            return;
+        connections_made++;
+
+        send_message(connection, MessageType::HELLO, image.image_width, image.image_height, image.sections.size());
+
+        SectionRenderInfo   tile;
+        std::vector<scalar> payload;
+        MessageHeader       assignment;
+        while(receive_message(connection, assignment) && assignment.type == MessageType::ASSIGN)
+        {
+            if(assignment.a >= image.sections.size())
+                break;
+
+            const SectionRenderInfo& bounds = image.sections[assignment.a];
+            tile.tile_x      = bounds.tile_x;
+            tile.tile_y      = bounds.tile_y;
+            tile.tile_width  = bounds.tile_width;
+            tile.tile_height = bounds.tile_height;
+            tile.passes_done  = 0;
+            tile.first_sample = assignment.c;
+
+            const std::size_t size = std::size_t(tile.tile_width) * tile.tile_height;
+            tile.mean.assign(size, Vec3());
+            tile.m2  .assign(size, 0.0f);
+            for(uint32_t pass = 0; pass < assignment.b; pass++)
+                sample_section_pass(&image, &tile);
+
+            payload.resize(4 * size);
+            for(std::size_t i = 0; i < size; i++)
+            {
+                payload[3 * i]     = tile.mean[i].r();
+                payload[3 * i + 1] = tile.mean[i].g();
+                payload[3 * i + 2] = tile.mean[i].b();
+            }
+            std::copy(tile.m2.begin(), tile.m2.end(), payload.begin() + 3 * size);
+
+            if(!send_message(connection, MessageType::RESULT, assignment.a, assignment.b) ||
+               !send_all(connection, payload.data(), payload.size() * sizeof(scalar)))
+                break;
+            passes_rendered += assignment.b;
+        }
+        close_socket(connection);
+    };
+
+    std::vector<std::thread> threads;
+    for(uint32_t i = 0; i < num_connections; i++)
+        threads.emplace_back(render_assignments);
+    for(std::thread& thread : threads)
+        thread.join();
+
+    if(connections_made == 0)
+        throw std::runtime_error("[Error] Could not connect to the coordinator at " + host + ":" + std::to_string(port));
+    return passes_rendered;
+}
@@ -0,0 +1,138 @@
+#ifndef UTIL_DISTRIBUTED_H
+#define UTIL_DISTRIBUTED_H
+
+#include "Threading.h"
+
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+using SocketHandle = std::uintptr_t;   // SOCKET
+#else
+using SocketHandle = int;
+#endif
+
+/**
+ * Messages are a fixed header, in the byte order of the machines taking
+ * part, which are assumed to share it. A RESULT is followed by the tile's
+ * mean colors (3 floats per pixel) and then its luminance M2 values.
+ *
+ * A worker connection sends HELLO once, then receives either ASSIGN,
+ * to which it answers with a RESULT, or DONE, after which it hangs up
+ **/
+enum class MessageType : uint32_t
+{
+    HELLO  = 1,   // a: image width, b: image height, c: number of tiles
+    ASSIGN = 2,   // a: tile, b: number of passes, c: index of the first sample
+    RESULT = 3,   // a: tile, b: number of passes
+    DONE   = 4
+};
+
+#pragma pack(1)
+struct MessageHeader
+{
+    uint32_t magic;      // 'R', 'T', 'D', 'S'
+    MessageType type;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+#pragma pack()
+
+/**
+ * Hands out passes over the tiles of image to workers connecting on port,
+ * and merges the samples they send back into it. Several chunks of the
+ * same tile may be out at once, as merging does not depend on order.
+ *
+ * A worker whose connection drops before it answers loses its chunk,
+ * which goes back to the pool for the next worker asking for work. So
+ * does one which takes longer than answer_timeout(), e.g. because it was
+ * suspended or its machine went down without closing the connection, and
+ * it is then disconnected. Once the time budget is spent, chunks still
+ * out are given up on rather than waited for.
+ *
+ * image.running_threads is 1 while the render is under way, so that it
+ * can be waited on like the local render threads
+ **/
+class RenderCoordinator {
+public:
+    static constexpr uint32_t PASSES_PER_ASSIGNMENT = 8;
+
+    /**
+     * A chunk is given up on after MIN_ANSWER_TIMEOUT seconds, or after
+     * ANSWER_TIMEOUT_FACTOR times the longest any chunk took to come back
+     * if that is longer, so that slow scenes do not cut off live workers.
+     * It also bounds how long a worker may stall in the middle of a message
+     **/
+    static constexpr uint32_t MIN_ANSWER_TIMEOUT    = 30;
+    static constexpr uint32_t ANSWER_TIMEOUT_FACTOR = 8;
+
+    RenderCoordinator(ImageRenderInfo& image, const uint16_t port);
+    ~RenderCoordinator();
+
+    RenderCoordinator(const RenderCoordinator&)            = delete;
+    RenderCoordinator& operator=(const RenderCoordinator&) = delete;
+
+    // Starts listening, throws if the port cannot be bound
+    void start();
+
+    // Waits for the workers to be told to stop
+    void stop();
+private:
+    void accept_workers();
+    void serve_worker(SocketHandle connection);
+
+    /**
+     * Picks the next tile in round robin order that still needs samples
+     * beyond those already handed out. Blocks while there are none but
+     * some are out, as they may come back unanswered. Returns false once
+     * the render is over. Sample indices are never handed out twice, so
+     * that no two chunks of a tile take the same samples
+     **/
+    bool next_assignment(uint32_t& tile, uint32_t& num_passes, uint32_t& first_sample);
+    void release_assignment(const uint32_t tile, const uint32_t num_passes);
+    bool is_render_over() const;
+
+    std::chrono::steady_clock::duration answer_timeout() const;
+
+    /**
+     * Waits until the worker on connection starts to answer its chunk,
+     * returns false if it took too long or the render no longer needs it
+     **/
+    bool wait_for_answer(SocketHandle connection);
+
+    ImageRenderInfo& image;
+    uint16_t         port;
+    SocketHandle     listener;
+
+    std::mutex                mutex;
+    std::condition_variable   work_changed;
+    std::vector<uint32_t>     passes_out;       // Handed out but not yet merged, per tile
+    std::vector<uint32_t>     next_sample;      // Index of the next sample to hand out, per tile
+    uint32_t                  total_out = 0;
+    uint32_t                  next_tile = 0;
+    bool                      stopping  = false;
+    std::vector<SocketHandle> connections;      // Of the workers being served
+    std::chrono::steady_clock::duration slowest_answer { 0 }; // Longest a chunk took to come back
+
+    std::thread               acceptor;
+    std::vector<std::thread>  workers;
+};
+
+/**
+ * Connects num_connections times to the coordinator at host:port and
+ * renders whatever each connection is assigned, one thread per
+ * connection, until told the render is done. image must be set up from
+ * the same scene as the coordinator's, but only its sections' bounds are
+ * used, as each thread samples into a private copy of the tile. Returns
+ * the number of tile passes rendered, or throws if no connection could
+ * be made at all
+ **/
+uint64_t run_render_worker(const std::string& host, const uint16_t port,
+                           const ImageRenderInfo& image, const uint32_t num_connections);
+
+#endif
@@ -2,16 +2,14 @@
 #ifndef UTIL_GENERAL_H
 #define UTIL_GENERAL_H
 
-#include <chrono>
-#include <random>
+#include "Sampler.h"
 
 using scalar = float;
 
+// Next dimension of the calling thread's Sampler, scaled to [min, max)
 inline scalar random_scalar(const float min = 0.0, const float max = 1.0)
 {
-    static thread_local std::mt19937_64 rng(std::chrono::high_resolution_clock::now().time_since_epoch().count());
-    std::uniform_real_distribution<scalar> distribution(min, max);
-    return distribution(rng);
+    return min + (max - min) * Sampler::current().next_1d();
 }
 
 template <typename T>
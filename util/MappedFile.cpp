@@ -0,0 +1,88 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#include <windows.h>
+
+MappedFile::MappedFile(const std::string& path)
+{
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        throw std::runtime_error("[Error] Could not find the file specified: " + path);
+    }
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file_handle, &file_size);
+    length = std::size_t(file_size.QuadPart);
+    if(length == 0)
+        return;
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping_handle != nullptr)
+        data = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if(data == nullptr)
+    {
+        if(mapping_handle != nullptr)
+            CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        throw std::runtime_error("[Error] Could not map the file: " + path);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if(data != nullptr)
+        UnmapViewOfFile(data);
+    if(mapping_handle != nullptr)
+        CloseHandle(mapping_handle);
+    if(file_handle != nullptr)
+        CloseHandle(file_handle);
+}
+
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("[Error] Could not find the file specified: " + path);
+
+    struct stat info;
+    if(fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("[Error] Could not read the size of the file: " + path);
+    }
+
+    length = std::size_t(info.st_size);
+    if(length > 0)
+    {
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("[Error] Could not map the file: " + path);
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapping);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if(data != nullptr)
+        munmap(const_cast<char*>(data), length);
+}
+
+#endif
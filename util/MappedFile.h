@@ -0,0 +1,33 @@
+#ifndef UTIL_MAPPED_FILE_H
+#define UTIL_MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+/**
+ * Read-only view of a whole file mapped into memory, so that it can be
+ * parsed in place without copying it into stream buffers first. Throws
+ * if the file cannot be opened or mapped
+ **/
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    inline const char* begin() const { return data; }
+    inline const char* end()   const { return data + length; }
+    inline std::size_t size()  const { return length; }
+private:
+    const char* data   = nullptr;
+    std::size_t length = 0;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+    void* file_handle    = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+#endif
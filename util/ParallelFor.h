@@ -0,0 +1,60 @@
+#ifndef UTIL_PARALLEL_FOR_H
+#define UTIL_PARALLEL_FOR_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <exception>
+#include <algorithm>
+
+// Threads available for loading and building, at least 1
+inline uint32_t hardware_threads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Calls task(i) for every i in [0, count) on up to hardware_threads()
+ * threads, each taking the next i as soon as it is done with the last,
+ * so tasks of uneven cost still balance. The first exception thrown by
+ * a task is rethrown once all threads have stopped
+ **/
+template <typename Task>
+void parallel_for(const uint32_t count, Task&& task)
+{
+    const uint32_t num_threads = std::min(count, hardware_threads());
+    if(num_threads <= 1)
+    {
+        for(uint32_t i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    std::atomic<uint32_t> next { 0 };
+    std::atomic<bool>     failed { false };
+    std::exception_ptr    error;
+
+    auto run_tasks = [&]() {
+        try {
+            for(uint32_t i = next++; i < count && !failed; i = next++)
+                task(i);
+        }
+        catch (...) {
+            if(!failed.exchange(true))
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(uint32_t t = 1; t < num_threads; t++)
+        threads.emplace_back(run_tasks);
+    run_tasks();
+    for(std::thread& thread : threads)
+        thread.join();
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef UTIL_SAMPLER_H
+#define UTIL_SAMPLER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * PCG32 (XSH RR) generator by O'Neill, 64 bits of state advanced by one
+ * multiply-add per number. Distinct streams never overlap
+ **/
+class PCG32 {
+public:
+    PCG32(const uint64_t seed = 0x853C49E6748FEA9Bull, const uint64_t stream = 0xDA3E39CB94B95BDBull)
+    {
+        set_seed(seed, stream);
+    }
+
+    inline void set_seed(const uint64_t seed, const uint64_t stream)
+    {
+        state = 0;
+        inc   = (stream << 1) | 1;
+        next();
+        state += seed;
+        next();
+    }
+
+    inline uint32_t next()
+    {
+        const uint64_t old = state;
+        state = old * 6364136223846793005ull + inc;
+        const uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        const uint32_t rot        = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // Uniform in [0, 1), from the top 24 bits
+    inline float next_float()
+    {
+        return float(next() >> 8) * 0x1p-24f;
+    }
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+/**
+ * The random numbers of a path, indexed by (pixel, sample, dimension) so
+ * that a given sample of a pixel always sees the same numbers, whichever
+ * thread or machine takes it and however many there are.
+ *
+ * Each call to next_1d() or next_2d() within a sample is a dimension of
+ * its own. With Type::SOBOL they come from Owen scrambled Sobol points,
+ * shuffled and scrambled independently per pixel and dimension (Burley,
+ * "Practical Hash-based Owen Scrambling", 2020), so the first 2^k samples
+ * of a pixel are stratified in every dimension and next_2d() pair, and
+ * noise drops faster than with independent numbers. Type::INDEPENDENT
+ * gives each sample its own PCG32 stream instead.
+ *
+ * Outside of start_sample() and end_sample() the numbers come from a
+ * stream of the calling thread
+ **/
+class Sampler {
+public:
+    enum class Type
+    {
+        INDEPENDENT,
+        SOBOL
+    };
+
+    // The sampler of the calling thread
+    static inline Sampler& current()
+    {
+        static thread_local Sampler sampler;
+        return sampler;
+    }
+
+    Sampler()
+    {
+        static std::atomic<uint64_t> next_stream { 0 };
+        thread_rng.set_seed(0x2545F4914F6CDD1Dull, next_stream++);
+    }
+
+    inline void start_sample(const Type     sequence,
+                             const uint32_t pixel_x,
+                             const uint32_t pixel_y,
+                             const uint32_t sample_index)
+    {
+        type       = sequence;
+        pixel_seed = hash(pixel_x, hash(pixel_y, 0x9E3779B9u));
+        index      = sample_index;
+        dimension  = 0;
+        in_sample  = true;
+        if(type == Type::INDEPENDENT)
+            sample_rng.set_seed(pixel_seed, sample_index);
+    }
+
+    inline void end_sample() { in_sample = false; }
+
+    /**
+     * Where a sample is up to, so that several can be started, set aside
+     * and later resumed in turn, e.g. once the camera rays of a whole ray
+     * packet have been traced
+     **/
+    struct SampleState
+    {
+        Type     type;
+        uint32_t pixel_seed;
+        uint32_t index;
+        uint32_t dimension;
+        PCG32    sample_rng;
+    };
+
+    // Ends the current sample, returning what resume_sample() needs to carry on with it
+    inline SampleState suspend_sample()
+    {
+        in_sample = false;
+        return SampleState { type, pixel_seed, index, dimension, sample_rng };
+    }
+
+    inline void resume_sample(const SampleState& state)
+    {
+        type       = state.type;
+        pixel_seed = state.pixel_seed;
+        index      = state.index;
+        dimension  = state.dimension;
+        sample_rng = state.sample_rng;
+        in_sample  = true;
+    }
+
+    // Uniform in [0, 1)
+    inline float next_1d()
+    {
+        if(!in_sample)
+            return thread_rng.next_float();
+        if(type == Type::INDEPENDENT)
+            return sample_rng.next_float();
+
+        const uint32_t seed     = hash(dimension++, pixel_seed);
+        const uint32_t shuffled = nested_uniform_scramble(index, seed);
+        return to_float(nested_uniform_scramble(reverse_bits(shuffled), hash(seed, 1)));
+    }
+
+    // Uniform in [0, 1)^2, stratified jointly
+    inline void next_2d(float& u, float& v)
+    {
+        if(!in_sample || type == Type::INDEPENDENT)
+        {
+            u = next_1d();
+            v = next_1d();
+            return;
+        }
+
+        const uint32_t seed     = hash(dimension++, pixel_seed);
+        const uint32_t shuffled = nested_uniform_scramble(index, seed);
+        u = to_float(nested_uniform_scramble(reverse_bits(shuffled), hash(seed, 1)));
+        v = to_float(nested_uniform_scramble(sobol_second(shuffled), hash(seed, 2)));
+    }
+private:
+    static inline uint32_t hash(uint32_t x, const uint32_t seed)
+    {
+        // lowbias32 by Wellons, mixed with the seed
+        x ^= seed * 0x9E3779B9u;
+        x ^= x >> 16;
+        x *= 0x7FEB352Du;
+        x ^= x >> 15;
+        x *= 0x846CA68Bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static inline uint32_t reverse_bits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+        x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+        return x;
+    }
+
+    // Each bit is flipped depending on those below it only
+    static inline uint32_t laine_karras_permutation(uint32_t x, const uint32_t seed)
+    {
+        x += seed;
+        x ^= x * 0x6C50B47Cu;
+        x ^= x * 0xB82F1E52u;
+        x ^= x * 0xC7AFE638u;
+        x ^= x * 0x8D22F6E6u;
+        return x;
+    }
+
+    // Owen scrambling of a 0.32 fixed point number, each bit flipped depending on those above it
+    static inline uint32_t nested_uniform_scramble(const uint32_t x, const uint32_t seed)
+    {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+    // Second dimension of the Sobol sequence, the first being reverse_bits()
+    static inline uint32_t sobol_second(uint32_t i)
+    {
+        uint32_t result = 0;
+        for(uint32_t v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1)
+        {
+            if(i & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    static inline float to_float(const uint32_t x)
+    {
+        return float(x >> 8) * 0x1p-24f;
+    }
+
+    Type     type       = Type::SOBOL;
+    uint32_t pixel_seed = 0;
+    uint32_t index      = 0;
+    uint32_t dimension  = 0;
+    bool     in_sample  = false;
+
+    PCG32 sample_rng;
+    PCG32 thread_rng;
+};
+
+#endif
@@ -1,4 +1,315 @@
 #include "Threading.h"
+#include "../graphics/Integrator.h"
+#include "../graphics/Wavefront.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    inline scalar luminance(const Color& c)
+    {
+        return 0.2126f * c.r() + 0.7152f * c.g() + 0.0722f * c.b();
+    }
+
+    // Interleaves the lower 16 bits of x with zeros
+    inline uint32_t spread_bits(uint32_t x)
+    {
+        x &= 0x0000FFFF;
+        x = (x | (x << 8)) & 0x00FF00FF;
+        x = (x | (x << 4)) & 0x0F0F0F0F;
+        x = (x | (x << 2)) & 0x33333333;
+        x = (x | (x << 1)) & 0x55555555;
+        return x;
+    }
+
+    inline uint32_t morton_code(uint32_t x, uint32_t y)
+    {
+        return spread_bits(x) | (spread_bits(y) << 1);
+    }
+}
+
+void create_tile_sections(ImageRenderInfo& image, const uint32_t tile_size, const bool allocate_samples)
+{
+    const uint32_t width_in_tiles  = (image.image_width  + tile_size - 1) / tile_size;
+    const uint32_t height_in_tiles = (image.image_height + tile_size - 1) / tile_size;
+
+    std::vector<std::pair<uint32_t, uint32_t>> order;   // (Morton code, tile)
+    order.reserve(width_in_tiles * height_in_tiles);
+    for(uint32_t tile_y = 0; tile_y < height_in_tiles; tile_y++)
+    {
+        for(uint32_t tile_x = 0; tile_x < width_in_tiles; tile_x++)
+            order.push_back({ morton_code(tile_x, tile_y), tile_y * width_in_tiles + tile_x });
+    }
+    std::sort(order.begin(), order.end());
+
+    // Sections hold atomics, so they are constructed in place
+    image.sections = std::vector<SectionRenderInfo>(order.size());
+    for(std::size_t i = 0; i < order.size(); i++)
+    {
+        SectionRenderInfo& section = image.sections[i];
+        section.tile_x      = (order[i].second % width_in_tiles) * tile_size;
+        section.tile_y      = (order[i].second / width_in_tiles) * tile_size;
+        section.tile_width  = std::min(tile_size, image.image_width  - section.tile_x);
+        section.tile_height = std::min(tile_size, image.image_height - section.tile_y);
+        if(allocate_samples)
+        {
+            section.mean.assign(section.tile_width * section.tile_height, Vec3());
+            section.m2  .assign(section.tile_width * section.tile_height, 0.0f);
+        }
+    }
+
+    image.total_work_units  = uint64_t(image.sections.size()) * image.num_samples;
+    image.next_work_unit    = 0;
+    image.finished_sections = 0;
+}
+
+double ImageRenderInfo::average_samples() const
+{
+    double total = 0.0;
+    for(const SectionRenderInfo& section : sections)
+        total += double(section.passes_done) * section.tile_width * section.tile_height;
+    return total / (double(image_width) * image_height);
+}
+
+/**
+ * Largest relative standard error of the mean luminance over the pixels
+ * of a tile with n samples. Dark pixels are measured against a floor, or
+ * they would never be deemed converged
+ **/
+static scalar estimate_tile_error(const SectionRenderInfo& section, const uint32_t n)
+{
+    const scalar MEAN_FLOOR = 0.05f;
+    const scalar VAR_DENOM  = 1 / (scalar(n) * scalar(n - 1));
+
+    scalar max_error = 0.0f;
+    for(std::size_t i = 0; i < section.mean.size(); i++)
+    {
+        const scalar std_error = std::sqrt(section.m2[i] * VAR_DENOM);
+        max_error = std::max(max_error, std_error / (MEAN_FLOOR + luminance(section.mean[i])));
+    }
+    return max_error;
+}
+
+/**
+ * Copies the means of a tile into the image and marks the tile done if
+ * it converged or ran out of samples
+ **/
+static void publish_section(ImageRenderInfo* image, SectionRenderInfo* section)
+{
+    const uint32_t n = section->passes_done;
+    {
+        std::lock_guard<std::mutex> guard(section->lock);
+        for(uint32_t y = 0; y < section->tile_height; y++)
+        {
+            Vec3* row = &image->pixels[(section->tile_y + y) * image->image_width + section->tile_x];
+            for(uint32_t x = 0; x < section->tile_width; x++)
+                row[x] = section->mean[y * section->tile_width + x];
+        }
+    }
+
+    const bool converged = image->error_threshold > 0 && 
+                           n >= std::max(2u, image->min_samples) &&
+                           estimate_tile_error(*section, n) < image->error_threshold;
+    if(!section->is_done && (converged || n >= image->num_samples))
+    {
+        section->is_done = true;
+        image->finished_sections++;
+    }
+}
+
+void sample_section_pass(const ImageRenderInfo* image, SectionRenderInfo* section)
+{
+    const scalar IW_DENOM = 1 / scalar(image->image_width);
+    const scalar IH_DENOM = 1 / scalar(image->image_height);
+
+    const uint32_t tile_x      = section->tile_x;
+    const uint32_t tile_y      = section->tile_y;
+    const uint32_t tile_width  = section->tile_width;
+    const uint32_t tile_height = section->tile_height;
+
+    const uint32_t n        = section->passes_done + 1;
+    const scalar   NS_DENOM = 1 / scalar(n);
+
+    // Every pixel takes the same sample of its own sequence
+    const uint32_t      sample_index = section->first_sample + n - 1;
+    const Sampler::Type sequence     = image->world->sampler_type;
+    Sampler&            sampler      = Sampler::current();
+
+    // Starts the sample of the pixel at (x, y) of the tile and returns its camera ray
+    auto start_pixel = [&](const uint32_t x, const uint32_t y) {
+        sampler.start_sample(sequence, tile_x + x, tile_y + y, sample_index);
+
+        scalar jitter_x, jitter_y;
+        sampler.next_2d(jitter_x, jitter_y);
+        scalar u = scalar(tile_x + x + jitter_x) * IW_DENOM;
+        scalar v = scalar(tile_y + y + jitter_y) * IH_DENOM;
+        return image->camera->get_ray(u, v);
+    };
+
+    // Welford's update, luminance being linear in the color
+    auto accumulate = [&](const uint32_t x, const uint32_t y, const Color& sample) {
+        const uint32_t i      = y * tile_width + x;
+        const scalar   lum    = luminance(sample);
+        const scalar   before = luminance(section->mean[i]);
+        section->mean[i] += (sample - section->mean[i]) * NS_DENOM;
+        section->m2[i]   += (lum - before) * (lum - luminance(section->mean[i]));
+    };
+
+    // In wavefront mode the paths of the whole tile are traced together
+    // once all of them have been started, otherwise each is traced at once
+    static thread_local Wavefront paths;
+    const bool wavefront = image->world->wavefront;
+    if(wavefront)
+        paths.resize(tile_width * tile_height);
+
+    // Carries on with the path of the pixel at (x, y) of the tile, from its camera ray's hit
+    auto trace_pixel = [&](const uint32_t x, const uint32_t y, const Ray& r, const bool hit, const HitRecord& rec) {
+        if(wavefront)
+        {
+            paths.start_path(y * tile_width + x, r, hit, rec, sampler.suspend_sample());
+            return;
+        }
+        const Color sample = color(r, hit, rec, *image->world);
+        sampler.end_sample();
+        accumulate(x, y, sample);
+    };
+
+    const uint32_t block = image->world->packet_size;
+    if(block == 0)
+    {
+        // color the current section of the image
+        for(uint32_t y = 0; y < tile_height; y++)
+        {
+            for(uint32_t x = 0; x < tile_width; x++)
+            {
+                const Ray  r   = start_pixel(x, y);
+                HitRecord  rec = {};
+                const bool hit = image->world->anything_hit(r, 1e-3, FLT_MAX, rec);
+                trace_pixel(x, y, r, hit, rec);
+            }
+        }
+    }
+    else
+    {
+        // The camera rays of each block of pixels are traced together as one
+        // packet, then every path carries on alone. Samples are set aside in
+        // the meantime, so that each still draws the same numbers as above
+        RayPacket packet;
+        std::vector<HitRecord>            recs  (block * block);
+        std::vector<Sampler::SampleState> states(block * block);
+
+        for(uint32_t block_y = 0; block_y < tile_height; block_y += block)
+        {
+            for(uint32_t block_x = 0; block_x < tile_width; block_x += block)
+            {
+                const uint32_t block_width  = std::min(block, tile_width  - block_x);
+                const uint32_t block_height = std::min(block, tile_height - block_y);
+
+                packet.reset(image->camera->origin, block_width * block_height);
+                for(uint32_t y = 0; y < block_height; y++)
+                {
+                    for(uint32_t x = 0; x < block_width; x++)
+                    {
+                        const uint32_t i = y * block_width + x;
+                        packet.set_direction(i, start_pixel(block_x + x, block_y + y).direction());
+                        states[i] = sampler.suspend_sample();
+                    }
+                }
+                packet.prepare();
+                image->world->anything_hit_packet(packet, 1e-3, recs.data());
+
+                for(uint32_t y = 0; y < block_height; y++)
+                {
+                    for(uint32_t x = 0; x < block_width; x++)
+                    {
+                        const uint32_t i = y * block_width + x;
+                        sampler.resume_sample(states[i]);
+                        trace_pixel(block_x + x, block_y + y, packet.ray(i), packet.t_max[i] < FLT_MAX, recs[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    if(wavefront)
+    {
+        paths.run(*image->world);
+        for(uint32_t y = 0; y < tile_height; y++)
+        {
+            for(uint32_t x = 0; x < tile_width; x++)
+                accumulate(x, y, paths.radiance(y * tile_width + x));
+        }
+    }
+
+    section->passes_done = n;
+}
+
+void render_section_pass(ImageRenderInfo* image, SectionRenderInfo* section)
+{
+    sample_section_pass(image, section);
+
+    // Publish the average so far
+    publish_section(image, section);
+}
+
+void merge_section_samples(ImageRenderInfo*   image,
+                           SectionRenderInfo* section,
+                           const uint32_t     num_passes,
+                           const Vec3*        mean,
+                           const scalar*      m2)
+{
+    const uint32_t n_a = section->passes_done;
+    const uint32_t n   = n_a + num_passes;
+    if(num_passes == 0)
+        return;
+
+    // Chan et al.'s pairwise combination of the two sets of moments
+    const scalar B_WEIGHT  = scalar(num_passes) / scalar(n);
+    const scalar AB_WEIGHT = scalar(n_a) * B_WEIGHT;
+    for(std::size_t i = 0; i < section->mean.size(); i++)
+    {
+        const Vec3   delta     = mean[i] - section->mean[i];
+        const scalar delta_lum = luminance(delta);
+        section->mean[i] += delta * B_WEIGHT;
+        section->m2[i]   += m2[i] + delta_lum * delta_lum * AB_WEIGHT;
+    }
+    section->passes_done = n;
+
+    publish_section(image, section);
+}
+
+int thread_render_image_tiles(RenderThreadControl* tcb)
+{
+    ImageRenderInfo* image = &tcb->image;
+
+    const uint64_t num_sections = image->sections.size();
+
+    while(std::chrono::steady_clock::now() < image->deadline)
+    {
+        // Claiming a unit is the only point where threads meet
+        const uint64_t unit = image->next_work_unit.fetch_add(1, std::memory_order_relaxed);
+        if(unit >= image->total_work_units)
+            break;
+
+        SectionRenderInfo* current_section = &image->sections[unit % num_sections];
+        if(current_section->is_done)
+            continue;
+
+        // Only waits when the previous pass over this tile is still running,
+        // i.e., when there are about as few tiles as there are threads
+        std::lock_guard<std::mutex> render_guard(current_section->render_lock);
+        if(current_section->is_done)
+            continue;
+
+        current_section->in_progress = true;
+        render_section_pass(image, current_section);
+        current_section->in_progress = false;
+    }
+
+    image->running_threads--;
+    return 0;
+}
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
 
@@ -29,6 +340,8 @@ int create_render_threads(ThreadHandle*  threads,
                           const uint32_t NUM_THREADS,
                           RenderThreadControl* tcontrol)
 {
+    // Counted down by each thread as it runs out of work
+    tcontrol->image.running_threads = NUM_THREADS;
     for(uint32_t i = 0; i < NUM_THREADS; i++)
     {
         threads[i].handle = CreateThread(NULL,               // Security options (default)
@@ -87,6 +400,8 @@ int create_render_threads(ThreadHandle*  threads,
                           const uint32_t NUM_THREADS,
                           RenderThreadControl* tcontrol)
 {
+    // Counted down by each thread as it runs out of work
+    tcontrol->image.running_threads = NUM_THREADS;
     for(uint32_t i = 0; i < NUM_THREADS; i++)
     {
         if(pthread_create(&threads[i].handle,
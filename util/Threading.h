@@ -3,35 +3,77 @@
 
 #include <mutex>
 #include <vector>
+#include <atomic>
+#include <chrono>
 #include "../graphics/Scene.h"
 #include "../graphics/Camera.h"
 #include "../math/Vector.h"
 
+/**
+ * A tile of the image. Its running mean and variance are accumulated by
+ * one thread at a time, whichever holds render_lock, and then copied into
+ * ImageRenderInfo::pixels under lock once per pass, so the display never
+ * sees a half-written tile
+ **/
 struct SectionRenderInfo
 {
-    uint32_t tile_width;
-    uint32_t tile_height;
-    uint32_t tile_x;
-    uint32_t tile_y;
-    bool     is_finished;
-    bool     in_progress;
+    uint32_t tile_width  = 0;
+    uint32_t tile_height = 0;
+    uint32_t tile_x      = 0;
+    uint32_t tile_y      = 0;
+
+    // Per pixel mean color, and Welford's sum of squared differences from
+    // the mean of its luminance, over the passes_done samples so far
+    std::vector<Vec3>   mean;
+    std::vector<scalar> m2;
+    std::mutex          render_lock;
+
+    std::atomic<uint32_t> passes_done { 0 };
+
+    // Sample index of pass 0, for tiles sampled apart from the image
+    uint32_t              first_sample = 0;
+    std::atomic<bool>     in_progress { false };
+    std::atomic<bool>     is_done     { false };  // Converged, or out of samples
+    std::mutex            lock;                   // Guards this tile's pixels
 };
 
+/**
+ * Work is handed out as units of one sample pass over one tile, by
+ * atomically incrementing next_work_unit. Unit i is a pass over tile
+ * i % sections.size(), so every tile gets a pass before any tile gets
+ * the next one, and the whole image refines evenly until the deadline.
+ *
+ * Once a tile has min_samples, its relative error is estimated after
+ * every pass and the tile is done when that falls below error_threshold;
+ * its later units are then skipped. A threshold of 0 disables this and
+ * every tile takes num_samples
+ **/
 struct ImageRenderInfo
 {
-    std::vector<SectionRenderInfo> sections;
+    std::vector<SectionRenderInfo> sections;   // In Morton order
     std::vector<Vec3> pixels;
 
-    uint32_t section_queue_front;
+    std::atomic<uint64_t> next_work_unit   { 0 };
+    std::atomic<uint32_t> finished_sections{ 0 };
+    std::atomic<uint32_t> running_threads  { 0 };
+    uint64_t total_work_units = 0;
 
-    uint32_t total_sections = 0;
-    uint32_t image_width;
-    uint32_t image_height;
-    uint32_t num_samples;
-    uint32_t num_finished_tiles = 0;
+    uint32_t image_width     = 0;
+    uint32_t image_height    = 0;
+    uint32_t num_samples     = 0;   // Most samples any pixel gets
+    uint32_t min_samples     = 16;
+    scalar   error_threshold = 0.0f;
 
-    Scene*  world;
-    Camera* camera;
+    // Threads stop claiming work past this point, even if it remains
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    Scene*  world  = nullptr;
+    Camera* camera = nullptr;
+
+    inline bool is_finished() const { return running_threads.load() == 0; }
+
+    // Mean number of samples taken per pixel so far
+    double average_samples() const;
 };
 
 struct RenderThreadControl;
@@ -74,6 +116,37 @@ void* pthread_render_tiles(void* param);
 
 #endif
 
+/**
+ * Splits the image into tiles of at most tile_size pixels on a side,
+ * ordered along a Morton (Z-order) curve so that the tiles handed out
+ * one after another lie next to each other, and sets up the work units.
+ * Without allocate_samples only the bounds of the tiles are set up
+ **/
+void create_tile_sections     (ImageRenderInfo& image, const uint32_t tile_size, const bool allocate_samples = true);
+
+/**
+ * Takes one more sample for every pixel of the tile and publishes the
+ * new means, the caller must hold the tile's render_lock
+ **/
+void render_section_pass(ImageRenderInfo* image, SectionRenderInfo* section);
+
+/**
+ * Only takes the samples, into a tile which need not belong to image,
+ * e.g. a worker's private copy of one of its tiles
+ **/
+void sample_section_pass(const ImageRenderInfo* image, SectionRenderInfo* section);
+
+/**
+ * Folds num_passes samples per pixel taken elsewhere, given as their
+ * means and luminance M2 in the tile's pixel order, into the tile and
+ * publishes the result. The caller must hold the tile's render_lock
+ **/
+void merge_section_samples(ImageRenderInfo*   image,
+                           SectionRenderInfo* section,
+                           const uint32_t     num_passes,
+                           const Vec3*        mean,
+                           const scalar*      m2);
+
 int  thread_render_image_tiles(RenderThreadControl* tcb);
 int  lock_mutex               (RenderThreadControl* tcb);
 int  unlock_mutex             (RenderThreadControl* tcb);